@@ -0,0 +1,16 @@
+; Recursive call workload for bench/lisp_time.c
+
+(def {fun} (\ {f b} {def (head f) (\ (tail f) b)}))
+
+(fun {fib n} {if (< n 2) {n} {+ (fib (- n 1)) (fib (- n 2))}})
+(fun {ack m n} {
+  if (== m 0) {+ n 1} {
+    if (== n 0) {ack (- m 1) 1} {ack (- m 1) (ack m (- n 1))}
+  }
+})
+
+(fun {loop n acc} {if (== n 0) {acc} {loop (- n 1) (+ acc n)}})
+
+(print (fib 22))
+(print (ack 2 300))
+(print (loop 1000000 0))
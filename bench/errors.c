@@ -0,0 +1,68 @@
+//Times expressions that fail, as input validation code does
+//when most of its input is bad. The work after the failing
+//argument should be skipped.
+//Build and run with `make bench`
+#include "../parsing.c"
+#include <time.h>
+
+#define CALLS 100000
+
+//Work that a failed expression shouldn't get round to
+char* defs_src =
+  "(def {spin} (\\ {n} {if (== n 0) {0} {spin (- n 1)}}))";
+
+//The forms in src
+lval* read_src(char* src){
+  mpc_result_t r;
+  if(!mpc_parse("<bench>", src, Lispy, &r)){
+    mpc_err_print(r.error);
+    mpc_err_delete(r.error);
+    exit(1);
+  }
+  lval* expr = lval_read(r.output);
+  mpc_ast_delete(r.output);
+  return expr;
+}
+
+//Time evaluating the single form in src
+void time_src(lenv* env, char* src){
+  lval* expr = read_src(src);
+  lval* x = expr->cell[0];
+  long errs = 0;
+  clock_t start = clock();
+  for(int i = 0; i < CALLS; i++){
+    lval* r = eval(env, lval_ref(x));
+    errs += LVAL_TYPE(r) == LVAL_ERR;
+    lval_del(r);
+  }
+  double secs = (double)(clock() - start) / CLOCKS_PER_SEC;
+  printf("%-36s %10.1f ns/call %8li errors\n", src,
+    secs * 1e9 / CALLS, errs);
+  lval_del(expr);
+}
+
+int main(int argc, char** argv){
+  parsers_init();
+  lenv* env = lenv_new();
+#ifdef LISPTER_GC
+  gc.root = env;
+#endif
+  len_add_builtins(env);
+  lval* defs = read_src(defs_src);
+  for(int i = 0; i < defs->count; i++){
+    lval_del(eval(env, lval_ref(defs->cell[i])));
+  }
+  lval_del(defs);
+
+  time_src(env, "(+ (/ 1 0) (spin 50) (spin 50))");
+  time_src(env, "(list (head {}) (spin 50))");
+  time_src(env, "(+ 1 nope (spin 50))");
+  time_src(env, "(list (error \"bad input\") (spin 50))");
+  time_src(env, "(/ 1 0)");
+  time_src(env, "(head {})");
+  time_src(env, "(+ 1 {a})");
+
+  lenv_del(env);
+  parsers_cleanup();
+  return 0;
+}
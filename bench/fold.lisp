@@ -0,0 +1,8 @@
+; Constant subexpressions in function bodies, for bench/lisp_time.c
+
+(def {fun} (\ {f b} {def (head f) (\ (tail f) b)}))
+(fun {secs n} {* n (* 60 60 24)})
+(fun {pick n} {+ n (- 100 (/ 60 3)) (* (- 10 3) (+ 2 2))})
+(fun {table n} {join (list n) (tail (join {1 2 3} (list 4 5 6)))})
+(fun {loop n acc} {if (== n 0) {acc} {loop (- n 1) (+ acc (secs n) (pick n) (eval (head (table n))))}})
+(print (loop 300000 0))
@@ -0,0 +1,82 @@
+//Measures lenv_get latency as the number of globals grows,
+//and the cost of a global reference in compiled code with
+//its cached entry and without.
+//Build and run with `make bench`
+#include "../parsing.c"
+#include <time.h>
+
+#define LOOKUPS 2000000
+//Global references in the compiled expression
+#define REFS 16
+
+int main(int argc, char** argv){
+  int sizes[] = {30, 100, 1000, 10000, 100000};
+  int nsizes = sizeof(sizes) / sizeof(sizes[0]);
+
+  printf("%10s %14s %14s %14s %14s\n", "globals", "ns/lookup", "ns/builtin",
+    "ns/cached", "ns/uncached");
+  for(int s = 0; s < nsizes; s++){
+    int n = sizes[s];
+
+    //Global env with the builtins plus n user definitions
+    lenv* env = lenv_new();
+    len_add_builtins(env);
+    lval** keys = malloc(sizeof(lval*) * n);
+    char name[32];
+    for(int i = 0; i < n; i++){
+      snprintf(name, sizeof(name), "g%i", i);
+      keys[i] = lval_sym(name);
+      lval* v = lval_num(i);
+      lenv_def(env, keys[i], v);
+      lval_del(v);
+    }
+
+    //Look up user definitions spread over the whole table
+    long sum = 0;
+    int k = 0;
+    clock_t start = clock();
+    for(int i = 0; i < LOOKUPS; i++){
+      k = (k + 7919) % n;
+      lval* x = lenv_get(env, keys[k]);
+      sum += LVAL_NUM_VAL(x);
+      lval_del(x);
+    }
+    double user_ns = (double)(clock() - start) / CLOCKS_PER_SEC * 1e9 / LOOKUPS;
+
+    //Look up a builtin, as every call to '+' does
+    lval* plus = lval_sym("+");
+    start = clock();
+    for(int i = 0; i < LOOKUPS; i++){
+      lval_del(lenv_get(env, plus));
+    }
+    double builtin_ns = (double)(clock() - start) / CLOCKS_PER_SEC * 1e9 / LOOKUPS;
+
+    //(list g.. g..) run as compiled code, first with the
+    //entries cached and then invalidating them on every run
+    lval* x = lval_add(lval_sexpr(), lval_sym("list"));
+    for(int i = 0; i < REFS; i++){
+      k = (k + 7919) % n;
+      x = lval_add(x, lval_ref(keys[k]));
+    }
+    double ref_ns[2];
+    for(int miss = 0; miss < 2; miss++){
+      start = clock();
+      for(int i = 0; i < LOOKUPS / REFS; i++){
+        if(miss){ lenv_version++; }
+        lval_del(lval_run(env, x));
+      }
+      ref_ns[miss] = (double)(clock() - start) / CLOCKS_PER_SEC * 1e9 / LOOKUPS;
+    }
+    lval_del(x);
+
+    printf("%10i %14.1f %14.1f %14.1f %14.1f\n", n, user_ns, builtin_ns,
+      ref_ns[0], ref_ns[1]);
+    if(sum < 0){ puts("unreachable"); }
+
+    lval_del(plus);
+    for(int i = 0; i < n; i++){ lval_del(keys[i]); }
+    free(keys);
+    lenv_del(env);
+  }
+  return 0;
+}
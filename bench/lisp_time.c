@@ -0,0 +1,28 @@
+//Times loading each Lisp file given on the command line.
+//Build and run with `make bench`
+#include "../parsing.c"
+#include <time.h>
+
+int main(int argc, char** argv){
+  parsers_init();
+
+  for(int i = 1; i < argc; i++){
+    lenv* env = lenv_new();
+#ifdef LISPTER_GC
+    gc.root = env;
+#endif
+    len_add_builtins(env);
+
+    clock_t start = clock();
+    lval* x = builtin_load(env, lval_add(lval_sexpr(), lval_str(argv[i])));
+    double secs = (double)(clock() - start) / CLOCKS_PER_SEC;
+
+    if(LVAL_TYPE(x) == LVAL_ERR){ lval_println(x); }
+    lval_del(x);
+    lenv_del(env);
+    printf("%s: %.3fs\n", argv[i], secs);
+  }
+
+  parsers_cleanup();
+  return 0;
+}
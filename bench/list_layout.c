@@ -0,0 +1,111 @@
+//Measures how much memory a list of numbers takes per element
+//and how well walking it uses the cache.
+//Build and run with `make bench`
+#define _GNU_SOURCE
+#include "../parsing.c"
+#include <time.h>
+#ifdef __linux__
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#endif
+
+#define ELEMS 200000
+#define PASSES 50
+
+//Open a hardware cache miss counter for this process, or
+//return -1 when the kernel won't give us one
+int misses_open(void){
+#ifdef __linux__
+  struct perf_event_attr pe;
+  memset(&pe, 0, sizeof(pe));
+  pe.type = PERF_TYPE_HARDWARE;
+  pe.size = sizeof(pe);
+  pe.config = PERF_COUNT_HW_CACHE_MISSES;
+  pe.disabled = 1;
+  pe.exclude_kernel = 1;
+  pe.exclude_hv = 1;
+  return syscall(SYS_perf_event_open, &pe, 0, -1, -1, 0);
+#else
+  return -1;
+#endif
+}
+
+void misses_start(int fd){
+#ifdef __linux__
+  if(fd < 0){ return; }
+  ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+  ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+#endif
+}
+
+long misses_stop(int fd){
+  long long n = -1;
+#ifdef __linux__
+  if(fd < 0){ return -1; }
+  ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+  if(read(fd, &n, sizeof(n)) != sizeof(n)){ n = -1; }
+#endif
+  return n;
+}
+
+void report(char* name, double secs, long misses){
+  printf("%-12s %10.1f ns/elem", name, secs * 1e9 / ((double)ELEMS * PASSES));
+  if(misses < 0){
+    printf(" %14s\n", "misses n/a");
+  } else {
+    printf(" %8.3f misses/elem\n", (double)misses / ((double)ELEMS * PASSES));
+  }
+}
+
+//A list of numbers with a few symbols mixed in, the way
+//lists.lisp builds them
+lval* build(void){
+  lval* l = lval_qexpr();
+  for(int i = 0; i < ELEMS; i++){
+    l = lval_add(l, i % 16 ? lval_num(i) : lval_sym("x"));
+  }
+  return l;
+}
+
+int main(int argc, char** argv){
+  parsers_init();
+  printf("sizeof(lval) %zu bytes\n", sizeof(lval));
+
+  size_t before = slab_bytes;
+  lval* a = build();
+  lval* b = build();
+  double per = (double)(slab_bytes - before) / (2.0 * ELEMS);
+  printf("%-12s %10.1f bytes/elem (+%zu for the cell pointer)\n",
+    "list", per, sizeof(lval*));
+
+  int fd = misses_open();
+
+  //Sum the numbers, touching every element
+  long sum = 0;
+  misses_start(fd);
+  clock_t start = clock();
+  for(int p = 0; p < PASSES; p++){
+    for(int i = 0; i < a->count; i++){
+      if(LVAL_TYPE(a->cell[i]) == LVAL_NUM){ sum += LVAL_NUM_VAL(a->cell[i]); }
+    }
+  }
+  report("sum", (double)(clock() - start) / CLOCKS_PER_SEC, misses_stop(fd));
+
+  //Structural comparison walks two lists side by side
+  long same = 0;
+  misses_start(fd);
+  start = clock();
+  for(int p = 0; p < PASSES; p++){
+    same += lval_eq(a, b);
+  }
+  report("lval_eq", (double)(clock() - start) / CLOCKS_PER_SEC, misses_stop(fd));
+
+  if(sum < 0 || same < 0){ puts("unreachable"); }
+  if(fd >= 0){ close(fd); }
+  lval_del(a);
+  lval_del(b);
+  parsers_cleanup();
+  return 0;
+}
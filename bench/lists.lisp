@@ -0,0 +1,18 @@
+; Recursive list processing workload for bench/lisp_time.c
+
+(def {nil} {})
+(def {fun} (\ {f b} {def (head f) (\ (tail f) b)}))
+(fun {fst l} {eval (head l)})
+
+(fun {range a b} {if (== a b) {nil} {join (list a) (range (+ a 1) b)}})
+(fun {map f l} {if (== l nil) {nil} {join (list (f (fst l))) (map f (tail l))}})
+(fun {filter f l} {if (== l nil) {nil} {join (if (f (fst l)) {head l} {nil}) (filter f (tail l))}})
+(fun {foldl f z l} {if (== l nil) {z} {foldl f (f z (fst l)) (tail l)}})
+(fun {reverse l} {if (== l nil) {nil} {join (reverse (tail l)) (head l)}})
+
+(fun {round n xs} {
+  foldl + n (filter (\ {x} {== 0 (% x 3)}) (map (\ {x} {* x x}) (reverse xs)))
+})
+(fun {repeat n acc xs} {if (== n 0) {acc} {repeat (- n 1) (round acc xs) xs}})
+
+(print (repeat 20 0 (range 0 500)))
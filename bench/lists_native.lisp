@@ -0,0 +1,10 @@
+; The lists.lisp workload using the builtin list functions
+
+(def {fun} (\ {f b} {def (head f) (\ (tail f) b)}))
+
+(fun {round n xs} {
+  foldl + n (filter (\ {x} {== 0 (% x 3)}) (map (\ {x} {* x x}) (reverse xs)))
+})
+(fun {repeat n acc xs} {if (== n 0) {acc} {repeat (- n 1) (round acc xs) xs}})
+
+(print (repeat 20 0 (range 0 500)))
@@ -0,0 +1,150 @@
+//Compares numeric vectors with the same work done on
+//Q-Expressions by Lisp code, and times each set of kernels.
+//Build and run with `make bench`
+#include "../parsing.c"
+#include <time.h>
+
+#define ELEMS 2000
+//The Q-Expression versions are much slower, so run them less
+#define CALLS 2000
+#define QCALLS 5
+#define KERNEL_ELEMS 100000
+#define KERNEL_PASSES 2000
+
+//Q-Expression versions of the numeric vector builtins,
+//walking the lists by index
+char* qexpr_src =
+  "(def {qsum} (\\ {l i acc} "
+  "  {if (== i (len l)) {acc} {qsum l (+ i 1) (+ acc (nth l i))}}))"
+  "(def {qdot} (\\ {x y i acc} "
+  "  {if (== i (len x)) {acc} "
+  "    {qdot x y (+ i 1) (+ acc (* (nth x i) (nth y i)))}}))"
+  "(def {qmax} (\\ {l i m} "
+  "  {if (== i (len l)) {m} "
+  "    {qmax l (+ i 1) (if (> (nth l i) m) {nth l i} {m})}}))"
+  "(def {qadd} (\\ {x y i acc} "
+  "  {if (== i (len x)) {acc} "
+  "    {qadd x y (+ i 1) (conj acc (+ (nth x i) (nth y i)))}}))";
+
+//The forms in src
+lval* read_src(char* src){
+  mpc_result_t r;
+  if(!mpc_parse("<bench>", src, Lispy, &r)){
+    mpc_err_print(r.error);
+    mpc_err_delete(r.error);
+    exit(1);
+  }
+  lval* expr = lval_read(r.output);
+  mpc_ast_delete(r.output);
+  return expr;
+}
+
+//Evaluate each form in expr, returning the last result
+lval* run(lenv* env, lval* expr){
+  lval* x = lval_sexpr();
+  for(int i = 0; i < expr->count; i++){
+    lval_del(x);
+    x = eval(env, lval_ref(expr->cell[i]));
+    if(LVAL_TYPE(x) == LVAL_ERR){ lval_println(x); }
+  }
+  return x;
+}
+
+//Define name as v globally, taking over the reference
+void def(lenv* env, char* name, lval* v){
+  lval* k = lval_sym(name);
+  lenv_def(env, k, v);
+  lval_del(k);
+  lval_del(v);
+}
+
+//Time evaluating src a number of times
+void time_src(lenv* env, char* src, int calls){
+  lval* expr = read_src(src);
+  long check = 0;
+  clock_t start = clock();
+  for(int i = 0; i < calls; i++){
+    lval* x = run(env, expr);
+    check += LVAL_TYPE(x) == LVAL_NUM ? LVAL_NUM_VAL(x) : lval_len(x);
+    lval_del(x);
+  }
+  double secs = (double)(clock() - start) / CLOCKS_PER_SEC;
+  printf("%-20s %10.2f ns/elem %14li\n", src,
+    secs * 1e9 / ((double)ELEMS * calls), check / calls);
+  lval_del(expr);
+}
+
+void time_kernels(lkernels* k, long* x, long* y, long* r){
+  long check = 0;
+  clock_t start = clock();
+  for(int p = 0; p < KERNEL_PASSES; p++){ check += k->sum(x, KERNEL_ELEMS); }
+  double sum = (double)(clock() - start) / CLOCKS_PER_SEC;
+
+  start = clock();
+  for(int p = 0; p < KERNEL_PASSES; p++){
+    k->add(r, x, y, KERNEL_ELEMS);
+    check += r[p % KERNEL_ELEMS];
+  }
+  double add = (double)(clock() - start) / CLOCKS_PER_SEC;
+
+  start = clock();
+  for(int p = 0; p < KERNEL_PASSES; p++){ check += k->dot(x, y, KERNEL_ELEMS); }
+  double dot = (double)(clock() - start) / CLOCKS_PER_SEC;
+
+  start = clock();
+  for(int p = 0; p < KERNEL_PASSES; p++){ check += k->max(x, KERNEL_ELEMS); }
+  double max = (double)(clock() - start) / CLOCKS_PER_SEC;
+
+  double per = 1e9 / ((double)KERNEL_ELEMS * KERNEL_PASSES);
+  printf("%-8s sum %6.3f  v+ %6.3f  dot %6.3f  max %6.3f ns/elem %li\n",
+    k->name, sum * per, add * per, dot * per, max * per, check);
+}
+
+int main(int argc, char** argv){
+  parsers_init();
+  lenv* env = lenv_new();
+#ifdef LISPTER_GC
+  gc.root = env;
+#endif
+  len_add_builtins(env);
+
+  //The same numbers as a Q-Expression and a numeric vector
+  lval* q = lval_qexpr();
+  for(int i = 0; i < ELEMS; i++){ q = lval_add(q, lval_num(i % 1000 - 500)); }
+  def(env, "v", builtin_nums(env, lval_add(lval_sexpr(), lval_ref(q))));
+  def(env, "q", q);
+  lval* defs = read_src(qexpr_src);
+  lval_del(run(env, defs));
+  lval_del(defs);
+
+  time_src(env, "(sum v)", CALLS);
+  time_src(env, "(qsum q 0 0)", QCALLS);
+  time_src(env, "(dot v v)", CALLS);
+  time_src(env, "(qdot q q 0 0)", QCALLS);
+  time_src(env, "(max v)", CALLS);
+  time_src(env, "(qmax q 0 -1000)", QCALLS);
+  time_src(env, "(v+ v v)", CALLS);
+  time_src(env, "(qadd q q 0 {})", QCALLS);
+
+  //The kernels on their own, for each instruction set the
+  //CPU has
+  long* x = malloc(sizeof(long) * KERNEL_ELEMS);
+  long* y = malloc(sizeof(long) * KERNEL_ELEMS);
+  long* r = malloc(sizeof(long) * KERNEL_ELEMS);
+  for(int i = 0; i < KERNEL_ELEMS; i++){
+    x[i] = i % 1000 - 500;
+    y[i] = i % 7;
+  }
+  time_kernels(&vk_scalar, x, y, r);
+#ifdef LISPTER_SIMD
+  if(__builtin_cpu_supports("sse4.2")){ time_kernels(&vk_sse, x, y, r); }
+  if(__builtin_cpu_supports("avx2")){ time_kernels(&vk_avx2, x, y, r); }
+#endif
+  free(x);
+  free(y);
+  free(r);
+
+  lenv_del(env);
+  parsers_cleanup();
+  return 0;
+}
@@ -0,0 +1,50 @@
+//Measures the per-argument cost of the arithmetic builtins
+//on long calls like (+ 1 2 ... 1000).
+//Build and run with `make bench`
+#include "../parsing.c"
+#include <time.h>
+
+#define ARGS 1000
+#define CALLS 20000
+
+//(op x1 x2 ... xn), with xi = i or all ones
+lval* build(char* op, int ones){
+  lval* x = lval_add(lval_sexpr(), lval_sym(op));
+  for(int i = 1; i <= ARGS; i++){
+    x = lval_add(x, lval_num(ones ? 1 : i));
+  }
+  return x;
+}
+
+void run(lenv* env, char* op, int ones){
+  lval* x = build(op, ones);
+  long check = 0;
+  clock_t start = clock();
+  for(int i = 0; i < CALLS; i++){
+    lval* r = eval(env, lval_ref(x));
+    check += LVAL_NUM_VAL(r);
+    lval_del(r);
+  }
+  double secs = (double)(clock() - start) / CLOCKS_PER_SEC;
+  printf("(%s 1 .. %i) %10.2f ns/arg %14li\n", op, ARGS,
+    secs * 1e9 / ((double)ARGS * CALLS), check / CALLS);
+  lval_del(x);
+}
+
+int main(int argc, char** argv){
+  parsers_init();
+  lenv* env = lenv_new();
+#ifdef LISPTER_GC
+  gc.root = env;
+#endif
+  len_add_builtins(env);
+
+  run(env, "+", 0);
+  run(env, "-", 0);
+  run(env, "*", 1);
+  run(env, "/", 1);
+
+  lenv_del(env);
+  parsers_cleanup();
+  return 0;
+}
@@ -0,0 +1,75 @@
+//Times walking a list with head and tail at doubling
+//lengths, run as top-level forms the way load runs them. The
+//time per element should stay flat as the list grows.
+//Build and run with `make bench`
+#include "../parsing.c"
+#include <time.h>
+
+//Rebinding a big global should cost the same as a small one
+#define REBINDS 2000
+#define REBIND_ELEMS 200000
+
+char* defs_src =
+  "(def {walk} (\\ {l acc} "
+  "  {if (== (len l) 0) {acc} {walk (tail l) (+ acc (eval (head l)))}}))"
+  "(def {again} (\\ {n} {if (== n 0) {0} {again2 (def {big} big) n}}))"
+  "(def {again2} (\\ {_ n} {again (- n 1)}))";
+
+//The forms in src
+lval* read_src(char* src){
+  mpc_result_t r;
+  if(!mpc_parse("<bench>", src, Lispy, &r)){
+    mpc_err_print(r.error);
+    mpc_err_delete(r.error);
+    exit(1);
+  }
+  lval* expr = lval_read(r.output);
+  mpc_ast_delete(r.output);
+  return expr;
+}
+
+//Evaluate each form in src as a top-level form, returning
+//the seconds taken
+double run(lenv* env, char* src){
+  lval* expr = read_src(src);
+  clock_t start = clock();
+  for(int i = 0; i < expr->count; i++){
+    arena_begin();
+    lval* x = eval(env, lval_ref(expr->cell[i]));
+    if(LVAL_TYPE(x) == LVAL_ERR){ lval_println(x); }
+    lval_del(x);
+    arena_end();
+  }
+  double secs = (double)(clock() - start) / CLOCKS_PER_SEC;
+  lval_del(expr);
+  return secs;
+}
+
+int main(int argc, char** argv){
+  parsers_init();
+  lenv* env = lenv_new();
+#ifdef LISPTER_GC
+  gc.root = env;
+#endif
+  len_add_builtins(env);
+  run(env, defs_src);
+
+  char src[128];
+  for(int n = 5000; n <= 80000; n *= 2){
+    sprintf(src, "(def {xs} (range 0 %i))", n);
+    run(env, src);
+    double secs = run(env, "(walk xs 0)");
+    printf("walk %6i elems %8.3fs %8.1f ns/elem\n", n, secs,
+      secs * 1e9 / n);
+  }
+
+  sprintf(src, "(def {big} (range 0 %i))", REBIND_ELEMS);
+  run(env, src);
+  sprintf(src, "(again %i)", REBINDS);
+  double secs = run(env, src);
+  printf("rebind %i elems %i times %8.3fs\n", REBIND_ELEMS, REBINDS, secs);
+
+  lenv_del(env);
+  parsers_cleanup();
+  return 0;
+}
@@ -1,8 +1,20 @@
 #include "mpc.h"
 #include <stdio.h>
 #include <string.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <limits.h>
 #include <assert.h>
 
+//Numeric vector kernels use SSE and AVX2 when the compiler
+//can target them, and pick the best the CPU has at run time.
+//Build with -DLISPTER_NO_SIMD to only use the scalar ones
+#if !defined(LISPTER_NO_SIMD) && defined(__GNUC__) &&\
+  (defined(__x86_64__) || defined(__i386__))
+#define LISPTER_SIMD
+#include <immintrin.h>
+#endif
+
 
 #ifdef _WIN32
 
@@ -25,9 +37,12 @@
 
 
 //Enumeration of possible lval types
-enum{LVAL_NUM, LVAL_ERR, LVAL_SYM, LVAL_SEXPR, LVAL_QEXPR, LVAL_FUN, LVAL_STR};
-//Enumeration of possible error types
-enum{LERR_DIV_ZERO, LERR_BAD_OP, LERR_BAD_NUM};
+enum{LVAL_NUM, LVAL_ERR, LVAL_SYM, LVAL_SEXPR, LVAL_QEXPR, LVAL_FUN, LVAL_STR,
+  LVAL_PVEC, LVAL_NUMS};
+//Errors common enough to be made once and shared (see
+//lval_err_common)
+enum{LERR_DIV_ZERO, LERR_BAD_NUM, LERR_HEAD_EMPTY, LERR_TAIL_EMPTY,
+  LERR_HEAD_EMPTY_VEC, LERR_TAIL_EMPTY_VEC, LERR_COUNT};
 
 //Parser Declarations
 mpc_parser_t* Number;
@@ -42,24 +57,55 @@ mpc_parser_t* Comment;
 //Forward declarations
 struct lval;
 struct lenv;
+struct lcode;
+struct lnode;
 typedef struct lval lval;
 typedef struct lenv lenv;
+typedef struct lcode lcode;
+typedef struct lnode lnode;
 void lval_print(lval* v);
 lval* lval_copy(lval* v);
+lval* lval_ref(lval* v);
+lval* lval_own(lval* v);
+lval* lval_promote(lval* v);
 void lval_del(lval* lv);
 lval* lval_err(char* fmt, ...);
-lval* eval_sexpr(lenv* env,lval* v);
+lval* lval_err_common(int e);
 typedef lval*(*lbuiltin)(lenv*, lval*);
+//Fast entry to a builtin for calls with a few args. Borrows
+//the n args from an array, and returns NULL when it can't
+//handle them so the full builtin runs instead
+typedef lval*(*lfast)(lval**, int);
 char* ltype_name(int t);
-lval* builtin_var(lenv* e, lval* a, char* func);
+//Kernels the operator builtins are built from. An lop folds
+//y into *x and returns 0 if it can't (division by zero)
+typedef int (*lop)(long*, long);
+typedef int (*lord)(long, long);
+typedef void (*lbind)(lenv*, lval*, lval*);
+lval* builtin_var(lenv* e, lval* a, char* func, lbind bind);
 lval* builtin_eval(lenv* env,lval* a);
+lval* builtin_if(lenv* env, lval* a);
+lval* builtin_lambda(lenv* e, lval* a);
+lval* builtin_def(lenv* env, lval* a);
+lval* builtin_put(lenv* env, lval* a);
 lval* pop(lval* v, int i);
 lval* builtin_list(lenv* env,lval* a);
-lval* builtin_ord(lenv* env, lval* a, char* op);
-lval* builtin_cmp(lenv* env, lval* a, char* op);
+lval* builtin_ord(lenv* env, lval* a, char* op, lord k);
+lval* builtin_cmp(lenv* env, lval* a, char* op, int eq);
 void lval_print_str(lval* v);
 lval* lval_read_str(mpc_ast_t* t);
 lval* eval(lenv* env, lval* v);
+lval* lval_run(lenv* env, lval* v);
+lval* lval_exec(lenv* env, lval* v, lenv* base);
+void lval_forget(lval* v);
+lcode* lcode_ref(lcode* c);
+void lcode_del(lcode* c);
+void lval_uncompile(lval* f);
+void lenv_layout(lenv* env, lval* formals);
+int lval_formals_eq(lval* x, lval* y);
+int lval_len(lval* v);
+lval* lval_nth(lval* v, int i);
+int lval_pure(lval* f);
 
 
 //Macro to help with error checking
@@ -76,114 +122,731 @@ lval* eval(lenv* env, lval* v);
     "Got %i, Expected %i",\
     func, args->count, num)
 #define LASSERT_TYPE(func, args, index, expect)\
-  LASSERT(args, args->cell[index]->type == expect,\
+  LASSERT(args, LVAL_TYPE(args->cell[index]) == expect,\
     "Function '%s'passed incorrect type of argument %i"\
     "Got %s, Expected %s",\
-    func, index, ltype_name(args->cell[index]->type),ltype_name(expect))
+    func, index, ltype_name(LVAL_TYPE(args->cell[index])),ltype_name(expect))
+
+//Macro checks an argument is a Q-Expression or a vector
+#define LASSERT_SEQ(func, args, index)\
+  LASSERT(args, LVAL_TYPE(args->cell[index]) == LVAL_QEXPR ||\
+    LVAL_TYPE(args->cell[index]) == LVAL_PVEC,\
+    "Function '%s'passed incorrect type of argument %i"\
+    "Got %s, Expected %s or %s",\
+    func, index, ltype_name(LVAL_TYPE(args->cell[index])),\
+    ltype_name(LVAL_QEXPR), ltype_name(LVAL_PVEC))
+
+//Like LASSERT, returning one of the shared common errors
+#define LASSERT_COMMON(args, cond, e) \
+  if(!(cond)){ \
+    lval_del(args); \
+    return lval_err_common(e);}
 
 #define LASSERT_NOT_EMPTY(func, args, index)\
   LASSERT(args, args->cell[index]->count != 0, \
     "Function '%s' passed {} for argument %i.", func, index);
 
-//List of relationships between names and values for our env
+//A single binding in an environment's hash table.
+//sym is an interned name and an empty slot has a NULL sym
+typedef struct{
+  char* sym;
+  unsigned long hash;
+  lval* val;
+} lentry;
+
+//Slots a lambda env holds without allocating
+#define LENV_FEW 3
+
+//Open addressing hash table of relationships between
+//names and values for our env
 struct lenv{
   lenv* parent;
   int count;
-  char** syms;
-  lval** vals;
+  int capacity;
+  lentry* entries;
+  //Lambda envs also have a fixed slot for each formal, in the
+  //order they're listed. Compiled bodies read them by index.
+  //An unbound slot has a NULL val, and a slot whose name is
+  //repeated later in the formals has a NULL sym
+  int nslots;
+  lentry* slots;
+  //Formals are bound in order, so the first bound slots are
+  //filled. amp is the number of formals before '&', whose
+  //symbol takes the rest slot right after them, or -1
+  int bound;
+  int amp;
+  //Small frames keep their slots here, so a call doesn't
+  //have to allocate them
+  lentry few[LENV_FEW];
+  //Envs belonging to lambdas are local. While a call runs,
+  //global is the env at the bottom of its parent chain
+  int local;
+  lenv* global;
+#ifdef LISPTER_GC
+  //Heap list link and collector bookkeeping. An env is
+  //dead once the function owning it has been released
+  lenv* gc_next;
+  int gc_mark;
+  int gc_dead;
+#endif
 };
 
+//lvals are reference counted. A value may be shared by
+//several lists and envs, so code that wants to modify one
+//must first take a private copy with lval_own().
+//Each type only uses its own member of the union, and is
+//allocated just big enough to hold it (see LVAL_SIZE)
 struct lval{
-  int type;
-  long num;
+  short type;
+  //Set once lval_promote has moved everything the value holds
+  //out of the arena, so promoting it again does nothing
+  short settled;
+  int rc;
+#ifdef LISPTER_GC
+  //Heap list link and collector bookkeeping
+  lval* gc_next;
+  int gc_mark;
+  int gc_refs;
+#endif
 
-  //We store error and symbol type as string data
-  char* sym;
-  char* err;
-  char* str;
+  union{
+    long num;
+
+    //We store error and string types as string data
+    char* err;
+    char* str;
+
+    //Symbol names are interned, so two symbols with the
+    //same name share one sym pointer. They carry the hash of
+    //their name so env lookups don't have to recompute it
+    struct{
+      char* sym;
+      unsigned long hash;
+    };
+
+    //Function. Builtins only use builtin and fast
+    struct{
+      lbuiltin builtin;
+      union{
+        lfast fast;
+        lenv* env;
+      };
+      lval* formals;
+      lval* body;
+      //Body compiled with the formals resolved to slots
+      lcode* compiled;
+    };
+
+    //Expression. code caches the bytecode compiled from it.
+    //cell has room for capacity elements, and starts off
+    //elements into its allocation after pops from the front.
+    //A slice instead views part of src's cells, which it
+    //holds a reference to, and must be unsliced to change
+    struct{
+      int count;
+      int slice;
+      union{
+        struct{
+          int capacity;
+          int off;
+        };
+        lval* src;
+      };
+      lval** cell;
+      lcode* code;
+    };
+
+    //Persistent vector. Its elements are those from start to
+    //end of a trie holding size elements. The last few of
+    //those are kept in the tail node, the rest under root
+    struct{
+      int start;
+      int end;
+      int size;
+      int shift;
+      lnode* root;
+      lnode* tail;
+    };
+
+    //Numeric vector. Its numbers are packed into data so the
+    //kernels can work on them directly
+    struct{
+      int length;
+      long* data;
+    };
+  };
+};
 
-  //Function
-  lbuiltin builtin;
-  lenv* env;
-  lval* formals;
-  lval* body;
+//Node of a persistent vector's trie. Nodes are shared by
+//vectors and only changed in place while a single vector
+//owns them, like lvals. Leaves hold elements, the nodes
+//above them hold up to VEC_WIDTH children
+#define VEC_BITS 5
+#define VEC_WIDTH (1 << VEC_BITS)
+#define VEC_MASK (VEC_WIDTH - 1)
+
+struct lnode{
+  int rc;
+  //Set if it may hold values from the arena
+  int dirty;
+#ifdef LISPTER_GC
+  //Collector pass that last walked it
+  long seen;
+#endif
+  union{
+    lnode* kids[VEC_WIDTH];
+    lval* vals[VEC_WIDTH];
+  };
+};
 
-  //Expression
-  int count;
-  lval** cell;
+//Numbers that fit in all but one bit of a pointer are kept
+//in the lval* itself instead of being allocated. Real lvals
+//are always aligned, so only fixnums have the low bit set.
+//Fixnums have no rc and are never freed; use LVAL_TYPE and
+//LVAL_NUM_VAL rather than ->type and ->num on anything that
+//might be a number
+#define FIX_MIN (LONG_MIN / 2)
+#define FIX_MAX (LONG_MAX / 2)
+#define LVAL_IS_FIX(v) ((uintptr_t)(v) & 1)
+#define LVAL_FIX(x) ((lval*)(((uintptr_t)(x) << 1) | 1))
+#define LVAL_FIX_VAL(v) ((long)((intptr_t)(v) >> 1))
+#define LVAL_TYPE(v) (LVAL_IS_FIX(v) ? LVAL_NUM : (v)->type)
+#define LVAL_NUM_VAL(v) (LVAL_IS_FIX(v) ? LVAL_FIX_VAL(v) : (v)->num)
+
+//Bytes needed by an lval whose variant ends with member
+#define LVAL_SIZE(member) \
+  (offsetof(lval, member) + sizeof(((lval*)0)->member))
+
+//Objects of each fixed size are carved out of slabs and
+//recycled through a free list for their size class, so
+//creating and deleting lvals rarely reaches malloc.
+//Numbers, strings and errors share the atom class, and
+//builtins and numeric vectors are the same size as symbols
+enum{SLAB_ATOM, SLAB_SYM, SLAB_EXPR, SLAB_LAMBDA, SLAB_LENV,
+  SLAB_VEC, SLAB_NODE, SLAB_CLASSES};
+
+//Number of objects carved out of each new slab
+#define SLAB_OBJECTS 256
+
+typedef struct{
+  char* name;
+  size_t size;
+  //Free objects, linked through their first word
+  void* free;
+  //Objects in use and objects carved out of slabs
+  long live;
+  long slots;
+  long slabs;
+} lslab;
+
+lslab slabs[SLAB_CLASSES] = {
+  {"atom", LVAL_SIZE(num)},
+  {"sym", LVAL_SIZE(hash)},
+  {"expr", LVAL_SIZE(code)},
+  {"lambda", LVAL_SIZE(compiled)},
+  {"lenv", sizeof(lenv)},
+  {"vec", LVAL_SIZE(tail)},
+  {"node", sizeof(lnode)},
 };
 
+//The slab class an lval of v's type was allocated from
+int lval_class(lval* v){
+  switch(v->type){
+    case LVAL_SYM: return SLAB_SYM;
+    case LVAL_SEXPR:
+    case LVAL_QEXPR: return SLAB_EXPR;
+    case LVAL_FUN: return v->builtin ? SLAB_SYM : SLAB_LAMBDA;
+    case LVAL_PVEC: return SLAB_VEC;
+    case LVAL_NUMS: return SLAB_SYM;
+    default: return SLAB_ATOM;
+  }
+}
+
+//Bytes held by live objects, and the most there has been
+size_t slab_bytes;
+size_t slab_peak_bytes;
+
+void* slab_alloc(int class){
+  lslab* c = &slabs[class];
+#ifdef LISPTER_NO_SLAB
+  //Debug builds can send everything to malloc so memory
+  //checkers see each object
+  void* p = malloc(c->size);
+  c->slots++;
+#else
+  if(!c->free){
+    //Thread a new slab's objects onto the free list
+    char* slab = malloc(c->size * SLAB_OBJECTS);
+    for(int i = SLAB_OBJECTS - 1; i >= 0; i--){
+      void* obj = slab + c->size * i;
+      *(void**)obj = c->free;
+      c->free = obj;
+    }
+    c->slots += SLAB_OBJECTS;
+    c->slabs++;
+  }
+  void* p = c->free;
+  c->free = *(void**)p;
+#endif
+  c->live++;
+  slab_bytes += c->size;
+  if(slab_bytes > slab_peak_bytes){ slab_peak_bytes = slab_bytes; }
+  return p;
+}
+
+void slab_free(int class, void* p){
+  lslab* c = &slabs[class];
+#ifdef LISPTER_NO_SLAB
+  free(p);
+  c->slots--;
+#else
+  *(void**)p = c->free;
+  c->free = p;
+#endif
+  c->live--;
+  slab_bytes -= c->size;
+}
+
+#ifdef LISPTER_GC
+//In GC mode lvals and lenvs aren't freed when their last
+//reference is released. They stay on these heap lists until
+//gc_collect() frees everything that can't be reached
+struct{
+  lval* lvals;
+  lenv* lenvs;
+  //The global env is always reachable
+  lenv* root;
+  //Objects on the heap lists and the count at which the
+  //next collection runs
+  long count;
+  long threshold;
+  //Env of the innermost running call. Call envs aren't held
+  //by any lval, so they are reached through its parents
+  lenv* frame;
+  //Bumped for each pass over the heap, so shared vector
+  //nodes are only walked once per pass
+  long pass;
+} gc = {NULL, NULL, NULL, 0, 4096, NULL, 0};
+
+void gc_collect(void);
+#endif
+
+//The lvals and lenvs made while evaluating a top-level form
+//are mostly garbage by the time it finishes. Outside GC and
+//debug builds they are bumped out of an arena that is reset
+//in one go after each form. Anything stored in an env that
+//outlives the arena is promoted to the slabs first
+#if !defined(LISPTER_GC) && !defined(LISPTER_NO_SLAB)
+#define LISPTER_ARENA
+#endif
+
+#ifdef LISPTER_ARENA
+#define ARENA_SIZE (256 << 10)
+
+struct{
+  char* base;
+  size_t used;
+  //Nesting of arena_begin. Only the outermost form resets
+  int depth;
+  //Arena objects that haven't been freed yet
+  long live;
+  long resets;
+  long promoted;
+} arena;
+
+//Whether p was allocated from the arena
+int arena_owns(void* p){
+  return (char*)p >= arena.base && (char*)p < arena.base + ARENA_SIZE;
+}
+
+//Bump allocate from the arena. Returns NULL outside a
+//top-level form or once the arena is full, and the caller
+//falls back to the slabs
+void* arena_alloc(size_t size){
+  size = (size + 7) & ~(size_t)7;
+  if(!arena.depth || arena.used + size > ARENA_SIZE){ return NULL; }
+  void* p = arena.base + arena.used;
+  arena.used += size;
+  arena.live++;
+  return p;
+}
+#endif
+
+//Start evaluating a top-level form
+void arena_begin(void){
+#ifdef LISPTER_ARENA
+  if(!arena.base){ arena.base = malloc(ARENA_SIZE); }
+  arena.depth++;
+#endif
+}
+
+//Finish a top-level form. If everything it allocated from
+//the arena has been freed the whole arena can be reused
+void arena_end(void){
+#ifdef LISPTER_ARENA
+  arena.depth--;
+  if(arena.depth == 0 && arena.live == 0){
+    arena.used = 0;
+    arena.resets++;
+  }
+#endif
+}
+
+//Allocate space for an lval from the given slab class. In
+//GC mode this may run a collection first, so callers must
+//not hold unreferenced lvals while calling it
+lval* lval_alloc(int class){
+#ifdef LISPTER_GC
+  if(gc.count >= gc.threshold){ gc_collect(); }
+  lval* v = slab_alloc(class);
+  v->gc_next = gc.lvals;
+  gc.lvals = v;
+  gc.count++;
+  return v;
+#else
+#ifdef LISPTER_ARENA
+  lval* v = arena_alloc(slabs[class].size);
+  if(!v){ v = slab_alloc(class); }
+  v->settled = 0;
+  return v;
+#else
+  return slab_alloc(class);
+#endif
+#endif
+}
+
+//Allocate space for an lenv. Never runs a collection
+lenv* lenv_alloc(void){
+#ifdef LISPTER_ARENA
+  lenv* a = arena_alloc(sizeof(lenv));
+  if(a){ return a; }
+#endif
+  lenv* env = slab_alloc(SLAB_LENV);
+#ifdef LISPTER_GC
+  env->gc_next = gc.lenvs;
+  env->gc_dead = 0;
+  gc.lenvs = env;
+  gc.count++;
+#endif
+  return env;
+}
+
+//FNV-1a hash of a symbol name
+unsigned long lsym_hash(char* s){
+  unsigned long h = 2166136261UL;
+  while(*s){
+    h ^= (unsigned char)*s++;
+    h *= 16777619UL;
+  }
+  return h;
+}
+
+//Interned names are stored after a small header
+typedef struct{
+  //Number of bindings of the symbol held by local envs.
+  //With none, lookups can go straight to the global env
+  int shadows;
+  //Set if it's the name of a builtin without side effects
+  //(see lpure), so calls through it may be folded
+  int pure;
+  char name[];
+} lsym;
+
+#define LSYM(s) ((lsym*)((s) - offsetof(lsym, name)))
+
+//Process-wide table of interned symbol names.
+//Names are never freed once interned
+struct{
+  int count;
+  int capacity;
+  char** names;
+  unsigned long* hashes;
+} lsym_table;
+
+//Return the interned copy of name, adding it if it's new.
+//If hash is non NULL it receives the hash of the name
+char* lsym_intern(char* name, unsigned long* hash){
+  //Keep the table at most half full
+  if((lsym_table.count + 1) * 2 > lsym_table.capacity){
+    int old_capacity = lsym_table.capacity;
+    char** old_names = lsym_table.names;
+    unsigned long* old_hashes = lsym_table.hashes;
+
+    lsym_table.capacity = old_capacity ? old_capacity * 2 : 256;
+    lsym_table.names = calloc(lsym_table.capacity, sizeof(char*));
+    lsym_table.hashes = malloc(sizeof(unsigned long) * lsym_table.capacity);
+    unsigned long mask = lsym_table.capacity - 1;
+    for(int i = 0; i < old_capacity; i++){
+      if(!old_names[i]){ continue; }
+      unsigned long j = old_hashes[i] & mask;
+      while(lsym_table.names[j]){ j = (j + 1) & mask; }
+      lsym_table.names[j] = old_names[i];
+      lsym_table.hashes[j] = old_hashes[i];
+    }
+    free(old_names);
+    free(old_hashes);
+  }
+
+  unsigned long h = lsym_hash(name);
+  if(hash){ *hash = h; }
+  unsigned long mask = lsym_table.capacity - 1;
+  unsigned long i = h & mask;
+  while(lsym_table.names[i]){
+    if(lsym_table.hashes[i] == h && strcmp(lsym_table.names[i], name) == 0){
+      return lsym_table.names[i];
+    }
+    i = (i + 1) & mask;
+  }
+
+  //Not seen before so keep a copy
+  lsym* n = malloc(sizeof(lsym) + strlen(name) + 1);
+  n->shadows = 0;
+  n->pure = 0;
+  strcpy(n->name, name);
+  lsym_table.names[i] = n->name;
+  lsym_table.hashes[i] = h;
+  lsym_table.count++;
+  return lsym_table.names[i];
+}
+
+//The interned '&' that marks variable arguments in formals
+char* lsym_amp(void){
+  static char* amp = NULL;
+  if(!amp){ amp = lsym_intern("&", NULL); }
+  return amp;
+}
+
+//The interned 'if', '\', 'def' and '=', which the compiler
+//treats specially
+char* lsym_if(void){
+  static char* sym = NULL;
+  if(!sym){ sym = lsym_intern("if", NULL); }
+  return sym;
+}
+
+char* lsym_lambda(void){
+  static char* sym = NULL;
+  if(!sym){ sym = lsym_intern("\\", NULL); }
+  return sym;
+}
+
+char* lsym_def(void){
+  static char* sym = NULL;
+  if(!sym){ sym = lsym_intern("def", NULL); }
+  return sym;
+}
+
+char* lsym_put(void){
+  static char* sym = NULL;
+  if(!sym){ sym = lsym_intern("=", NULL); }
+  return sym;
+}
+
 //Create a new lenv (environment)
 lenv* lenv_new(void){
-  lenv* env = malloc(sizeof(lenv));
+  lenv* env = lenv_alloc();
   env->count = 0;
-  env->syms = NULL;
-  env->vals = NULL;
+  env->capacity = 0;
+  env->entries = NULL;
   env->parent = NULL;
+  env->local = 0;
+  env->global = NULL;
+  env->nslots = 0;
+  env->slots = NULL;
+  env->bound = 0;
+  env->amp = -1;
   return env;
 }
 
+//The slot for sym, or NULL if env has none
+lentry* lenv_slot(lenv* env, char* sym){
+  for(int i = 0; i < env->nslots; i++){
+    if(env->slots[i].sym == sym){ return &env->slots[i]; }
+  }
+  return NULL;
+}
+
+//Room for n slots in env
+lentry* lenv_slots(lenv* env, int n){
+  if(n <= LENV_FEW){ return env->few; }
+  return malloc(sizeof(lentry) * n);
+}
+
+//Give a local env an unbound slot for each of the formals
+void lenv_layout(lenv* env, lval* formals){
+  env->slots = lenv_slots(env, formals->count);
+  memset(env->slots, 0, sizeof(lentry) * formals->count);
+  for(int i = 0; i < formals->count; i++){
+    lval* sym = formals->cell[i];
+    if(sym->sym == lsym_amp()){
+      if(env->amp < 0){ env->amp = env->nslots; }
+      continue;
+    }
+    //The last formal with a name wins, as if each was bound in
+    //turn, so an earlier slot for it loses its name
+    lentry* old = lenv_slot(env, sym->sym);
+    if(old){
+      LSYM(old->sym)->shadows--;
+      old->sym = NULL;
+    }
+    lentry* e = &env->slots[env->nslots++];
+    e->sym = sym->sym;
+    e->hash = sym->hash;
+    LSYM(e->sym)->shadows++;
+  }
+}
+
+//Free the memory of an environment itself
+void lenv_free(lenv* env){
+  free(env->entries);
+  if(env->slots != env->few){ free(env->slots); }
+#ifdef LISPTER_ARENA
+  if(arena_owns(env)){
+    arena.live--;
+    return;
+  }
+#endif
+  slab_free(SLAB_LENV, env);
+}
+
+//Bumped whenever a global env's bindings change, which
+//invalidates the entries cached by compiled code
+long lenv_version = 1;
+
 //delete an environment
 void lenv_del(lenv* env){
-  for(int i = 0; i < env->count; i++){
-    free(env->syms[i]);
-    lval_del(env->vals[i]);
+  //Code may have cached entries of a global env
+  if(!env->local){ lenv_version++; }
+  for(int i = 0; i < env->capacity; i++){
+    if(env->entries[i].sym){
+      lval_del(env->entries[i].val);
+      if(env->local){ LSYM(env->entries[i].sym)->shadows--; }
+    }
+  }
+  for(int i = 0; i < env->nslots; i++){
+    if(env->slots[i].val){ lval_del(env->slots[i].val); }
+    if(env->slots[i].sym){ LSYM(env->slots[i].sym)->shadows--; }
+  }
+#ifdef LISPTER_GC
+  env->gc_dead = 1;
+#else
+  lenv_free(env);
+#endif
+}
+
+//Find the slot holding the interned sym, or the empty slot
+//where it would be inserted. The table must have a free slot
+lentry* lenv_find(lenv* env, char* sym, unsigned long hash){
+  //capacity is always a power of two so we can mask
+  unsigned long mask = env->capacity - 1;
+  unsigned long i = hash & mask;
+  while(1){
+    lentry* e = &env->entries[i];
+    if(!e->sym || e->sym == sym){ return e; }
+    //Linear probing
+    i = (i + 1) & mask;
+  }
+}
+
+//Double the size of the table and rehash every entry
+void lenv_grow(lenv* env){
+  int old_capacity = env->capacity;
+  lentry* old = env->entries;
+
+  env->capacity = old_capacity ? old_capacity * 2 : 8;
+  env->entries = calloc(env->capacity, sizeof(lentry));
+  for(int i = 0; i < old_capacity; i++){
+    if(old[i].sym){
+      *lenv_find(env, old[i].sym, old[i].hash) = old[i];
+    }
   }
-  free(env->syms);
-  free(env->vals);
-  free(env);
+  free(old);
 }
 
 lval* lenv_get(lenv* env,lval* k){
-  //Iterate over all the items in the env
-  for(int i = 0; i < env->count; i++){
-    //Check if the stored string matches the symbol string
-    //If it does return a copy of the value
-    if(strcmp(env->syms[i],k->sym) == 0){
-      return lval_copy(env->vals[i]);
+  //Skip the local envs if none of them can bind k
+  if(env->global && LSYM(k->sym)->shadows == 0){
+    env = env->global;
+  }
+  //Look in each env, walking up to the global one
+  for(; env; env = env->parent){
+    lentry* s = lenv_slot(env, k->sym);
+    if(s && s->val){ return lval_ref(s->val); }
+    if(env->count == 0){ continue; }
+    //If the symbol is in this env return a reference to the value
+    lentry* e = lenv_find(env, k->sym, k->hash);
+    if(e->sym){
+      return lval_ref(e->val);
     }
   }
-  //If no symbol was found check in parent
-  if(env->parent){
-    return lenv_get(env->parent, k);
-  } else{
-    return lval_err("unbound symbol '%s'", k->sym);
-  } 
+  return lval_err("unbound symbol '%s'", k->sym);
 }
 
 void lenv_put(lenv* env, lval* k, lval* var){
-  //Iterate over all the items in the env to see
-  // it the variable already exists
-  for(int i = 0; i < env->count; i++){
-    //if it exists delete the old value and replace it
-    //with the value provided by the user
-    if(strcmp(env->syms[i], k->sym)== 0){
-      lval_del(env->vals[i]);
-      env->vals[i] = lval_copy(var);
-      return;
-    }
+  if(!env->local){ lenv_version++; }
+  var = lval_ref(var);
+#ifdef LISPTER_ARENA
+  //An env outside the arena may outlive the current form,
+  //so the value must not point into the arena
+  if(!arena_owns(env)){ var = lval_promote(var); }
+#endif
+
+  //Formals are always bound in their slots
+  lentry* s = lenv_slot(env, k->sym);
+  if(s){
+    if(s->val){ lval_del(s->val); }
+    s->val = var;
+    return;
+  }
+
+  //Keep the table at most half full so probe
+  //sequences stay short
+  if((env->count + 1) * 2 > env->capacity){
+    lenv_grow(env);
   }
-  //If no existing entry was found, allocate space for new entry
-  env->count++;
-  env->vals = realloc(env->vals, sizeof(lval*) * env->count);
-  env->syms = realloc(env->syms, sizeof(char*) * env->count);
 
-  //Copy the content of lval and symbol strings into new location
-  env->vals[env->count-1] = lval_copy(var);
-  env->syms[env->count-1] = malloc(strlen(k->sym)+1);
-  strcpy(env->syms[env->count-1], k->sym);
+  lentry* e = lenv_find(env, k->sym, k->hash);
+  //if it exists delete the old value and replace it
+  //with the value provided by the user
+  if(e->sym){
+    lval_del(e->val);
+    e->val = var;
+    return;
+  }
+
+  //Otherwise fill the empty slot with the symbol and a
+  //reference to the value
+  env->count++;
+  if(env->local){ LSYM(k->sym)->shadows++; }
+  e->sym = k->sym;
+  e->hash = k->hash;
+  e->val = var;
 }
 
 lenv* lenv_copy(lenv* env){
-  lenv* n = malloc(sizeof(lenv));
+  lenv* n = lenv_alloc();
   n->parent = env->parent;
+  n->local = env->local;
+  n->global = env->global;
   n->count = env->count;
-  n->syms = malloc(sizeof(char*)  * n->count);
-  n->vals = malloc(sizeof(lval*) * n->count);
-  for(int i = 0; i < env->count; i++){
-    n->syms[i]= malloc(strlen(env->syms[i])+1);
-    strcpy(n->syms[i], env->syms[i]);
-    n->vals[i] = lval_copy(env->vals[i]);
+  n->capacity = env->capacity;
+  n->entries = n->capacity ? calloc(n->capacity, sizeof(lentry)) : NULL;
+  for(int i = 0; i < env->capacity; i++){
+    if(env->entries[i].sym){
+      n->entries[i].sym = env->entries[i].sym;
+      n->entries[i].hash = env->entries[i].hash;
+      n->entries[i].val = lval_ref(env->entries[i].val);
+      if(n->local){ LSYM(n->entries[i].sym)->shadows++; }
+    }
+  }
+  n->nslots = env->nslots;
+  n->slots = lenv_slots(n, n->nslots);
+  n->bound = env->bound;
+  n->amp = env->amp;
+  for(int i = 0; i < n->nslots; i++){
+    n->slots[i] = env->slots[i];
+    if(n->slots[i].val){ lval_ref(n->slots[i].val); }
+    if(n->slots[i].sym){ LSYM(n->slots[i].sym)->shadows++; }
   }
   return n;
 }
@@ -199,94 +862,265 @@ void lenv_def(lenv* env, lval* k, lval* v){
 }
 
 lval* lval_str(char* str){
-  lval* v = malloc(sizeof(lval));
+  lval* v = lval_alloc(SLAB_ATOM);
   v->type = LVAL_STR;
+  v->rc = 1;
   v->str = malloc(strlen(str) + 1);
   strcpy(v->str, str);
   return v;
 }
 
 lval* lval_fun(lbuiltin func){
-  lval* v = malloc(sizeof(lval));
+  lval* v = lval_alloc(SLAB_SYM);
   v->type = LVAL_FUN;
+  v->rc = 1;
   v->builtin = func;
+  v->fast = NULL;
   return v;
 }
 
 lval* lval_lambda(lval* formals, lval* body){
-  lval* v = malloc(sizeof(lval));
+  lval* v = lval_alloc(SLAB_LAMBDA);
   v->type = LVAL_FUN;
+  v->rc = 1;
   //Builtin is Null because this is user defined func
   v->builtin = NULL;
   v->env = lenv_new();
+  v->env->local = 1;
+  lenv_layout(v->env, formals);
+  v->compiled = NULL;
   v->formals = formals;
   v->body = body;
   return v;
 }
 
+//Numbers are only boxed when they are too big for a fixnum
 lval* lval_num(long x){
-  lval* v = malloc(sizeof(lval));
+  if(x >= FIX_MIN && x <= FIX_MAX){ return LVAL_FIX(x); }
+  lval* v = lval_alloc(SLAB_ATOM);
   v->type = LVAL_NUM;
+  v->rc = 1;
   v->num = x;
   return v;
 }
 
 lval* lval_err(char* fmt, ...){
-  lval* v = malloc(sizeof(lval));
+  lval* v = lval_alloc(SLAB_ATOM);
   v->type = LVAL_ERR;
+  v->rc = 1;
   //Create a va list and initialize it
   //va is put for variable argument list
   va_list va;
   va_start(va, fmt);
 
-  //Allocate 512 bytes of space
-  v->err = malloc(512);
-
-  //printf the error string with a maximum of 511
-  //characters
-  vsnprintf(v->err, 511, fmt, va);
-  //Reallocate to number of bytes actually used
-  v->err = realloc(v->err, strlen(v->err)+1);
+  //printf the error string into 512 bytes on the stack with
+  //a maximum of 510 characters, then copy out only the bytes
+  //actually used
+  char buf[512];
+  int n = vsnprintf(buf, 511, fmt, va);
+  if(n < 0){ n = 0; buf[0] = '\0'; }
+  if(n > 510){ n = 510; }
+  v->err = malloc(n + 1);
+  memcpy(v->err, buf, n + 1);
 
   //cleanup the va list
   va_end(va);
 
   return v;
 }
+
+char* lerr_msgs[LERR_COUNT] = {
+  "Division By zero!",
+  "invalid number",
+  "Function head passed {}!",
+  "Function tail passed {}!",
+  "Function head passed []!",
+  "Function tail passed []!",
+};
+
+//The shared errors, made the first time they're needed
+lval* lerrs[LERR_COUNT];
+
+//An error with one of the fixed messages in lerr_msgs. Each
+//is made once outside the arena and GC heap, and the table
+//keeps a reference so it's never freed
+lval* lval_err_common(int e){
+  if(!lerrs[e]){
+    lval* v = slab_alloc(SLAB_ATOM);
+    v->type = LVAL_ERR;
+    v->settled = 1;
+    v->rc = 1;
+    v->err = malloc(strlen(lerr_msgs[e]) + 1);
+    strcpy(v->err, lerr_msgs[e]);
+    lerrs[e] = v;
+  }
+  return lval_ref(lerrs[e]);
+}
 /*Pointer to a new symbol lval*/
 lval* lval_sym(char* s){
-  lval* v = malloc(sizeof(lval));
+  lval* v = lval_alloc(SLAB_SYM);
   v->type = LVAL_SYM;
-  v->sym = malloc(strlen(s)+1);
-  strcpy(v->sym,s);
+  v->rc = 1;
+  v->sym = lsym_intern(s, &v->hash);
   return v;
 }
 
 /*Pointer to a new empty s-expression*/
 lval* lval_sexpr(void){
-  lval* v = malloc(sizeof(lval));
+  lval* v = lval_alloc(SLAB_EXPR);
   v->type = LVAL_SEXPR;
+  v->rc = 1;
   v->count = 0;
-
+  v->slice = 0;
+  v->capacity = 0;
+  v->off = 0;
   v->cell = NULL;
+  v->code = NULL;
 
   return v;
 }
 //A pointer to a new empty Qexpr lval
 lval* lval_qexpr(void){
-  lval* v = malloc(sizeof(lval));
+  lval* v = lval_alloc(SLAB_EXPR);
   v->type = LVAL_QEXPR;
+  v->rc = 1;
   v->count = 0;
+  v->slice = 0;
+  v->capacity = 0;
+  v->off = 0;
   v->cell = NULL;
+  v->code = NULL;
   return v;
 }
 
-void lval_del(lval* lv){
+//A new empty node
+lnode* lnode_new(void){
+  lnode* n = slab_alloc(SLAB_NODE);
+  n->rc = 1;
+  n->dirty = 0;
+#ifdef LISPTER_GC
+  n->seen = 0;
+#endif
+  memset(n->vals, 0, sizeof(n->vals));
+  return n;
+}
+
+lnode* lnode_ref(lnode* n){
+  n->rc++;
+  return n;
+}
+
+//Release a node at the given level of the trie, where
+//leaves are level 0
+void lnode_del(lnode* n, int level){
+  if(--n->rc > 0){ return; }
+  for(int i = 0; i < VEC_WIDTH; i++){
+    if(level){
+      if(n->kids[i]){ lnode_del(n->kids[i], level - VEC_BITS); }
+    }else{
+      if(n->vals[i]){ lval_del(n->vals[i]); }
+    }
+  }
+  slab_free(SLAB_NODE, n);
+}
+
+//Put x, which the node takes, in a leaf
+void lnode_put(lnode* n, int i, lval* x){
+  n->vals[i] = x;
+#ifdef LISPTER_ARENA
+  if(!LVAL_IS_FIX(x) && arena_owns(x)){ n->dirty = 1; }
+#endif
+}
+
+//Put the child k, which the node takes, in a node
+void lnode_kid(lnode* n, int i, lnode* k){
+  n->kids[i] = k;
+  n->dirty |= k->dirty;
+}
 
+//Take the caller's reference to n and return a node it can
+//change, copying n if anything else holds it
+lnode* lnode_own(lnode* n, int level){
+  if(n->rc == 1){ return n; }
+  lnode* x = lnode_new();
+  x->dirty = n->dirty;
+  for(int i = 0; i < VEC_WIDTH; i++){
+    if(level){
+      if(n->kids[i]){ x->kids[i] = lnode_ref(n->kids[i]); }
+    }else{
+      if(n->vals[i]){ x->vals[i] = lval_ref(n->vals[i]); }
+    }
+  }
+  n->rc--;
+  return x;
+}
+
+//A new empty persistent vector
+lval* lval_pvec(void){
+  lval* v = lval_alloc(SLAB_VEC);
+  v->type = LVAL_PVEC;
+  v->rc = 1;
+  v->start = 0;
+  v->end = 0;
+  v->size = 0;
+  v->shift = VEC_BITS;
+  v->root = lnode_new();
+  v->tail = lnode_new();
+  return v;
+}
+
+//A numeric vector with room for n numbers, which are left
+//for the caller to fill in
+lval* lval_nums(int n){
+  lval* v = lval_alloc(SLAB_SYM);
+  v->type = LVAL_NUMS;
+  v->rc = 1;
+  v->length = n;
+  v->data = malloc(sizeof(long) * (n > 0 ? n : 1));
+  return v;
+}
+
+//Free the memory of an lval itself, without releasing
+//the lvals it refers to
+void lval_free(lval* lv){
   switch(lv->type){
     case LVAL_STR:
       free(lv->str);
       break;
+    case LVAL_ERR: 
+      free(lv->err);
+      break;
+    case LVAL_NUMS:
+      free(lv->data);
+      break;
+    //free the memory allocated to contain the pointers
+    case LVAL_QEXPR:
+    case LVAL_SEXPR:
+      if(!lv->slice){ free(lv->cell - lv->off); }
+      lval_forget(lv);
+      break;
+    case LVAL_FUN:
+      if(!lv->builtin){ lcode_del(lv->compiled); }
+      break;
+  }
+
+#ifdef LISPTER_ARENA
+  //Arena space is reclaimed when the arena is reset
+  if(arena_owns(lv)){
+    arena.live--;
+    return;
+  }
+#endif
+  //Return the lval struct itself to its slab
+  slab_free(lval_class(lv), lv);
+}
+
+//Release a reference to an lval, freeing it once
+//nothing else shares it
+void lval_del(lval* lv){
+  if(LVAL_IS_FIX(lv) || --lv->rc > 0){ return; }
+
+  switch(lv->type){
     case LVAL_FUN:
       if(!lv->builtin){
         lenv_del(lv->env);
@@ -294,134 +1128,487 @@ void lval_del(lval* lv){
         lval_del(lv->body);
       }
       break;
-    case LVAL_NUM:
-      break;
-    case LVAL_ERR: 
-      free(lv->err);
-      break;
-    case LVAL_SYM:
-      free(lv->sym);
+    case LVAL_PVEC:
+      lnode_del(lv->root, lv->shift);
+      lnode_del(lv->tail, 0);
       break;
-    //If S-Expr or Q-Expr delete all elements inside
+    //If S-Expr or Q-Expr release all elements inside, or
+    //the list a slice views
     case LVAL_QEXPR:
     case LVAL_SEXPR:
+      if(lv->slice){
+        lval_del(lv->src);
+        break;
+      }
       for(int i =0; i < lv->count; i++){
         lval_del(lv->cell[i]);
       }
-      //free the memory allocated to contain the pointers
-      free(lv->cell);
       break;
   }
 
-  //Free the memory allocated for the lval struct itself
-  free(lv);
+#ifndef LISPTER_GC
+  lval_free(lv);
+#endif
 }
 
-lval* lval_read_num(mpc_ast_t* t){
+#ifdef LISPTER_GC
+void gc_unref(lval* v){ if(!LVAL_IS_FIX(v)){ v->gc_refs--; } }
+void gc_release(lval* v){ if(!LVAL_IS_FIX(v)){ v->rc--; } }
 
-  errno = 0;
-  long x = strtol(t->contents,NULL,10);
-  if(errno != ERANGE){
-    return lval_num(x);
+//Apply fn to every lval bound in env
+void lenv_each(lenv* env, void (*fn)(lval*)){
+  for(int i = 0; i < env->capacity; i++){
+    if(env->entries[i].sym){ fn(env->entries[i].val); }
   }
-  else{
-    return lval_err("invalid number");
+  for(int i = 0; i < env->nslots; i++){
+    if(env->slots[i].val){ fn(env->slots[i].val); }
   }
-
-}
-
-lval* lval_add(lval* v, lval* x){
-  v->count++;
-  v->cell = realloc(v->cell,sizeof(lval*) * v->count);
-  v->cell[v->count-1] = x;
-  return v;
 }
 
-lval* lval_read(mpc_ast_t* t){
-  if(strstr(t->tag,"string")){return lval_read_str(t);}
-  /*If symbol or number return conversion to that type*/
-  if(strstr(t->tag,"number")){ return lval_read_num(t);}
-  if(strstr(t->tag,"symbol")){ return lval_sym(t->contents); }
-  /*ifroot (>) or sexpr then create an empty list*/
-  lval* x = NULL;
-  if(strcmp(t->tag,">")==0){x = lval_sexpr();}
-  if(strstr(t->tag,"sexpr")){x = lval_sexpr();}
-  if(strstr(t->tag,"qexpr")){x = lval_qexpr();}
-
-  /*Fill in this list with any valid expressions contained within*/
-  for(int i = 0; i < t->children_num; i++){
-    if(strstr(t->children[i]->tag, "comment")){continue;}
-    if(strcmp(t->children[i]->contents, "(") == 0) {continue; }
-    if(strcmp(t->children[i]->contents, ")") == 0) {continue; }
-    if(strcmp(t->children[i]->contents, "{") == 0) {continue; }
-    if(strcmp(t->children[i]->contents, "}") == 0) {continue; }
-    if(strcmp(t->children[i]->tag, "regex") == 0) {continue; }
-    x = lval_add(x, lval_read(t->children[i]));
+//Apply fn to every lval held by a vector node and the nodes
+//below it, skipping nodes already walked in this pass
+void lnode_each(lnode* n, int level, void (*fn)(lval*)){
+  if(n->seen == gc.pass){ return; }
+  n->seen = gc.pass;
+  for(int i = 0; i < VEC_WIDTH; i++){
+    if(level){
+      if(n->kids[i]){ lnode_each(n->kids[i], level - VEC_BITS, fn); }
+    }else{
+      if(n->vals[i]){ fn(n->vals[i]); }
+    }
   }
-
-  return x;
-}
-
-lval* lval_read_str(mpc_ast_t* t){
-  //Remove the final quote character
-  t->contents[strlen(t->contents)-1]='\0';
-  //copy the sring that is missing the first quote char
-  char* unescaped = malloc(strlen(t->contents+1)+1);
-  strcpy(unescaped, t->contents+1);
-  //pass it through the unescaped func
-  unescaped = mpcf_unescape(unescaped);
-  //Create a new lval using the string
-  lval* str = lval_str(unescaped);
-  free(unescaped);
-  return str;
 }
 
-//print an s-expr
-void lval_expr_print(lval* v, char open, char close){
-  putchar(open);
-  //Print value contained within
-  for(int i = 0; i < v->count; i++){
-    lval_print(v->cell[i]);
-
-    //Don't print trailing space if last element
-    if(i!=(v->count-1)){
-      putchar(' ');
+//Let go of a node held by a dead vector. Its values are
+//only released once no vector holds the node
+void lnode_release(lnode* n, int level){
+  if(--n->rc > 0){ return; }
+  for(int i = 0; i < VEC_WIDTH; i++){
+    if(level){
+      if(n->kids[i]){ lnode_release(n->kids[i], level - VEC_BITS); }
+    }else{
+      if(n->vals[i]){ gc_release(n->vals[i]); }
     }
-
   }
-
-  putchar(close);
+  slab_free(SLAB_NODE, n);
 }
 
-//Print an lval
-void lval_print(lval* v){
+//Apply fn to every lval that v refers to, including the
+//values bound in a lambda's env
+void lval_each(lval* v, void (*fn)(lval*)){
   switch(v->type){
-    case LVAL_STR:
-      lval_print_str(v);
+    case LVAL_PVEC:
+      lnode_each(v->root, v->shift, fn);
+      lnode_each(v->tail, 0, fn);
       break;
     case LVAL_FUN:
-      if(v->builtin){
-        printf("< builtin function>");
-      } else{
-        printf("(\\"); lval_print(v->formals);
-        putchar(' '); lval_print(v->body);
-        putchar(')');
+      if(!v->builtin){
+        fn(v->formals);
+        fn(v->body);
+        lenv_each(v->env, fn);
       }
       break;
-    case LVAL_NUM:
-      printf("%li",v->num);
+    case LVAL_QEXPR:
+    case LVAL_SEXPR:
+      if(v->slice){
+        fn(v->src);
+        break;
+      }
+      for(int i = 0; i < v->count; i++){ fn(v->cell[i]); }
+      break;
+  }
+}
+
+
+void gc_mark(lval* v){
+  if(LVAL_IS_FIX(v) || v->gc_mark){ return; }
+  v->gc_mark = 1;
+  if(v->type == LVAL_FUN && !v->builtin){ v->env->gc_mark = 1; }
+  lval_each(v, gc_mark);
+}
+
+//Mark everything reachable from the global env or from the
+//eval stack and free the rest.
+//The eval stack isn't walked directly. Instead every
+//reference from the heap is subtracted from each count, and
+//anything left with references must be held by C code
+void gc_collect(void){
+  for(lval* v = gc.lvals; v; v = v->gc_next){
+    v->gc_mark = 0;
+    v->gc_refs = v->rc;
+  }
+  for(lenv* e = gc.lenvs; e; e = e->gc_next){ e->gc_mark = 0; }
+
+  //Released lvals have already let go of their references
+  gc.pass++;
+  for(lval* v = gc.lvals; v; v = v->gc_next){
+    if(v->rc > 0){ lval_each(v, gc_unref); }
+  }
+  if(gc.root){ lenv_each(gc.root, gc_unref); }
+
+  //Mark from the roots
+  gc.pass++;
+  if(gc.root){
+    gc.root->gc_mark = 1;
+    lenv_each(gc.root, gc_mark);
+  }
+  for(lenv* e = gc.frame; e; e = e->parent){
+    e->gc_mark = 1;
+    lenv_each(e, gc_mark);
+  }
+  for(lval* v = gc.lvals; v; v = v->gc_next){
+    if(v->gc_refs > 0){ gc_mark(v); }
+  }
+
+  //Anything unmarked that still has references is part of
+  //a cycle. Let go of its references before freeing it
+  for(lval* v = gc.lvals; v; v = v->gc_next){
+    if(v->gc_mark || v->rc == 0){ continue; }
+    //Vector nodes may also be held by live vectors
+    if(v->type == LVAL_PVEC){
+      lnode_release(v->root, v->shift);
+      lnode_release(v->tail, 0);
+    }else{
+      lval_each(v, gc_release);
+    }
+  }
+
+  //Sweep
+  gc.count = 0;
+  lval** lv = &gc.lvals;
+  while(*lv){
+    lval* v = *lv;
+    if(v->gc_mark){
+      lv = &v->gc_next;
+      gc.count++;
+    }else{
+      *lv = v->gc_next;
+      lval_free(v);
+    }
+  }
+  lenv** le = &gc.lenvs;
+  while(*le){
+    lenv* e = *le;
+    if(e->gc_mark){
+      le = &e->gc_next;
+      gc.count++;
+    }else{
+      *le = e->gc_next;
+      lenv_free(e);
+    }
+  }
+
+  //Let the heap double before collecting again
+  gc.threshold = gc.count * 2 > 4096 ? gc.count * 2 : 4096;
+}
+#endif
+
+lval* lval_read_num(mpc_ast_t* t){
+
+  errno = 0;
+  long x = strtol(t->contents,NULL,10);
+  if(errno != ERANGE){
+    return lval_num(x);
+  }
+  else{
+    return lval_err_common(LERR_BAD_NUM);
+  }
+
+}
+
+//Make room for n more cells at the end of v
+void lval_reserve(lval* v, int n){
+  if(v->count + n <= v->capacity){ return; }
+  lval** base = v->cell - v->off;
+  //Reuse the space left by pops from the front once it's as
+  //big as what's left
+  if(v->off && v->off >= v->count){
+    memmove(base, v->cell, sizeof(lval*) * v->count);
+    v->cell = base;
+    v->capacity += v->off;
+    v->off = 0;
+    if(v->count + n <= v->capacity){ return; }
+  }
+  //Grow geometrically so building a list is linear
+  int size = (v->off + v->capacity) * 2;
+  if(size < v->off + v->count + n){ size = v->off + v->count + n; }
+  if(size < 4){ size = 4; }
+  base = realloc(base, sizeof(lval*) * size);
+  v->cell = base + v->off;
+  v->capacity = size - v->off;
+}
+
+//Give the empty list v exactly n cells, for the caller to fill
+void lval_cells(lval* v, int n){
+  v->count = n;
+  v->capacity = n;
+  v->cell = n ? malloc(sizeof(lval*) * n) : NULL;
+}
+
+//A list viewing n of v's cells from i, without copying them
+lval* lval_slice(lval* v, int i, int n){
+  lval* x = lval_alloc(SLAB_EXPR);
+  x->type = v->type;
+  x->rc = 1;
+  x->count = n;
+  x->slice = 1;
+  x->src = lval_ref(v->slice ? v->src : v);
+  x->cell = v->cell + i;
+  x->code = NULL;
+  return x;
+}
+
+//Give the slice v its own copy of the cells it views
+void lval_unslice(lval* v){
+  lval* src = v->src;
+  lval** cell = v->cell;
+  v->slice = 0;
+  v->off = 0;
+  lval_cells(v, v->count);
+  for(int i = 0; i < v->count; i++){
+    v->cell[i] = lval_ref(cell[i]);
+  }
+  lval_del(src);
+}
+
+lval* lval_add(lval* v, lval* x){
+  v = lval_own(v);
+  lval_reserve(v, 1);
+  v->cell[v->count++] = x;
+  return v;
+}
+
+//Index of the first element kept in the tail node of a trie
+//holding size elements
+int pvec_tailoff(int size){
+  return size < VEC_WIDTH ? 0 : ((size - 1) >> VEC_BITS) << VEC_BITS;
+}
+
+//The element at i of v's trie, without a reference
+lval* pvec_get(lval* v, int i){
+  if(i >= pvec_tailoff(v->size)){ return v->tail->vals[i & VEC_MASK]; }
+  lnode* n = v->root;
+  for(int level = v->shift; level > 0; level -= VEC_BITS){
+    n = n->kids[(i >> level) & VEC_MASK];
+  }
+  return n->vals[i & VEC_MASK];
+}
+
+//Replace the element at i under n with x. Takes the caller's
+//reference to n and returns the node to use in its place
+lnode* lnode_set(lnode* n, int level, int i, lval* x){
+  n = lnode_own(n, level);
+  if(level == 0){
+    lval_del(n->vals[i & VEC_MASK]);
+    lnode_put(n, i & VEC_MASK, x);
+  }else{
+    int k = (i >> level) & VEC_MASK;
+    lnode_kid(n, k, lnode_set(n->kids[k], level - VEC_BITS, i, x));
+  }
+  return n;
+}
+
+//A chain of new nodes from level down to the leaf
+lnode* lnode_path(int level, lnode* leaf){
+  if(level == 0){ return leaf; }
+  lnode* n = lnode_new();
+  lnode_kid(n, 0, lnode_path(level - VEC_BITS, leaf));
+  return n;
+}
+
+//Hang the full leaf holding elements from i under n. Takes
+//the caller's reference to n and returns the node to use
+lnode* lnode_push(lnode* n, int level, int i, lnode* leaf){
+  n = lnode_own(n, level);
+  int k = (i >> level) & VEC_MASK;
+  if(level == VEC_BITS){
+    lnode_kid(n, k, leaf);
+  }else if(n->kids[k]){
+    lnode_kid(n, k, lnode_push(n->kids[k], level - VEC_BITS, i, leaf));
+  }else{
+    lnode_kid(n, k, lnode_path(level - VEC_BITS, leaf));
+  }
+  return n;
+}
+
+//Replace the element at i of v's trie. v must not be shared
+void pvec_set(lval* v, int i, lval* x){
+  if(i >= pvec_tailoff(v->size)){
+    v->tail = lnode_set(v->tail, 0, i, x);
+  }else{
+    v->root = lnode_set(v->root, v->shift, i, x);
+  }
+}
+
+//Add x after the last element of v's trie. v must not be
+//shared
+void pvec_push(lval* v, lval* x){
+  int size = v->size;
+  if(size - pvec_tailoff(size) < VEC_WIDTH){
+    v->tail = lnode_own(v->tail, 0);
+    lnode_put(v->tail, size & VEC_MASK, x);
+  }else{
+    //The tail is full, so it moves into the trie. If the
+    //root has no room left the trie grows a level
+    if((size >> VEC_BITS) > (1 << v->shift)){
+      lnode* root = lnode_new();
+      lnode_kid(root, 0, v->root);
+      lnode_kid(root, 1, lnode_path(v->shift, v->tail));
+      v->root = root;
+      v->shift += VEC_BITS;
+    }else{
+      v->root = lnode_push(v->root, v->shift, pvec_tailoff(size), v->tail);
+    }
+    v->tail = lnode_new();
+    lnode_put(v->tail, 0, x);
+  }
+  v->size++;
+}
+
+//Add x to the end of the vector v. Like lval_add it takes
+//both, and only copies the nodes on the path it changes
+lval* pvec_conj(lval* v, lval* x){
+  v = lval_own(v);
+  //A slice that stops short of the end of its trie reuses
+  //the slot after it
+  if(v->end < v->size){
+    pvec_set(v, v->end, x);
+  }else{
+    pvec_push(v, x);
+  }
+  v->end++;
+  return v;
+}
+
+//Replace the element at i of the vector v with x
+lval* pvec_assoc(lval* v, int i, lval* x){
+  v = lval_own(v);
+  pvec_set(v, v->start + i, x);
+  return v;
+}
+
+//The elements of the vector v from i up to j, sharing its
+//trie
+lval* pvec_slice(lval* v, int i, int j){
+  v = lval_own(v);
+  v->end = v->start + j;
+  v->start += i;
+  return v;
+}
+
+//Number of elements in a Q-Expression or vector
+int lval_len(lval* v){
+  if(v->type == LVAL_NUMS){ return v->length; }
+  return v->type == LVAL_PVEC ? v->end - v->start : v->count;
+}
+
+//The element at i of a Q-Expression or vector, without a
+//reference
+lval* lval_nth(lval* v, int i){
+  return v->type == LVAL_PVEC ? pvec_get(v, v->start + i) : v->cell[i];
+}
+
+lval* lval_read(mpc_ast_t* t){
+  if(strstr(t->tag,"string")){return lval_read_str(t);}
+  /*If symbol or number return conversion to that type*/
+  if(strstr(t->tag,"number")){ return lval_read_num(t);}
+  if(strstr(t->tag,"symbol")){ return lval_sym(t->contents); }
+  /*ifroot (>) or sexpr then create an empty list*/
+  lval* x = NULL;
+  if(strcmp(t->tag,">")==0){x = lval_sexpr();}
+  if(strstr(t->tag,"sexpr")){x = lval_sexpr();}
+  if(strstr(t->tag,"qexpr")){x = lval_qexpr();}
+
+  /*Fill in this list with any valid expressions contained within*/
+  for(int i = 0; i < t->children_num; i++){
+    if(strstr(t->children[i]->tag, "comment")){continue;}
+    if(strcmp(t->children[i]->contents, "(") == 0) {continue; }
+    if(strcmp(t->children[i]->contents, ")") == 0) {continue; }
+    if(strcmp(t->children[i]->contents, "{") == 0) {continue; }
+    if(strcmp(t->children[i]->contents, "}") == 0) {continue; }
+    if(strcmp(t->children[i]->tag, "regex") == 0) {continue; }
+    x = lval_add(x, lval_read(t->children[i]));
+  }
+
+  return x;
+}
+
+lval* lval_read_str(mpc_ast_t* t){
+  //Remove the final quote character
+  t->contents[strlen(t->contents)-1]='\0';
+  //copy the sring that is missing the first quote char
+  char* unescaped = malloc(strlen(t->contents+1)+1);
+  strcpy(unescaped, t->contents+1);
+  //pass it through the unescaped func
+  unescaped = mpcf_unescape(unescaped);
+  //Create a new lval using the string
+  lval* str = lval_str(unescaped);
+  free(unescaped);
+  return str;
+}
+
+//print an s-expr
+void lval_expr_print(lval* v, int from, char open, char close){
+  putchar(open);
+  //Print value contained within
+  for(int i = from; i < v->count; i++){
+    lval_print(v->cell[i]);
+
+    //Don't print trailing space if last element
+    if(i!=(v->count-1)){
+      putchar(' ');
+    }
+
+  }
+
+  putchar(close);
+}
+
+//Print an lval
+void lval_print(lval* v){
+  switch(LVAL_TYPE(v)){
+    case LVAL_STR:
+      lval_print_str(v);
+      break;
+    case LVAL_FUN:
+      if(v->builtin){
+        printf("< builtin function>");
+      } else{
+        //Only the formals still to be bound
+        printf("(\\"); lval_expr_print(v->formals, v->env->bound, '{', '}');
+        putchar(' '); lval_print(v->body);
+        putchar(')');
+      }
+      break;
+    case LVAL_NUM:
+      printf("%li",LVAL_NUM_VAL(v));
       break;
     case LVAL_ERR:
       printf("ERROR: %s", v->err);
       break;
     case LVAL_SEXPR:
-      lval_expr_print(v,'(',')' );
+      lval_expr_print(v, 0, '(', ')');
       break;
     case LVAL_SYM:
       printf("SYM: %s",v->sym);
       break;
     case LVAL_QEXPR:
-      lval_expr_print(v,'{', '}');
+      lval_expr_print(v, 0, '{', '}');
+      break;
+    case LVAL_PVEC:
+      putchar('[');
+      for(int i = 0; i < lval_len(v); i++){
+        if(i){ putchar(' '); }
+        lval_print(lval_nth(v, i));
+      }
+      putchar(']');
+      break;
+    case LVAL_NUMS:
+      putchar('<');
+      for(int i = 0; i < v->length; i++){
+        printf(i ? " %li" : "%li", v->data[i]);
+      }
+      putchar('>');
       break;
   }
 }
@@ -444,155 +1631,331 @@ void lval_print_str(lval* v){
   free(escaped);
 }
 
-//Copy an lval
+//Copy an lval. Children of lists and functions are
+//shared with the original rather than copied
 lval* lval_copy(lval* v){
-  lval* x = malloc(sizeof(lval));
+  if(LVAL_IS_FIX(v)){ return v; }
+  lval* x = lval_alloc(lval_class(v));
   x->type = v->type;
+  x->rc = 1;
 
   switch(v->type){
     case LVAL_STR:
       x->str = malloc(strlen(v->str)+1);
       strcpy(x->str, v->str);
       break;
-    //Copy functions and numbers directly
+    //Copy builtins directly and share the parts of lambdas
     case LVAL_FUN:
       if(v->builtin){
         x->builtin = v->builtin;
+        x->fast = v->fast;
       } else {
         x->builtin = NULL;
-        x->formals = lval_copy(v->formals);
-        x->body = lval_copy(v->body);
+        x->formals = lval_ref(v->formals);
+        x->body = lval_ref(v->body);
         x->env = lenv_copy(v->env);
+        x->compiled = lcode_ref(v->compiled);
       }
       break;
     case LVAL_NUM:
       x->num = v->num;
       break;
-    //Copy strings and symbols with malloc and strcpy
+    //Symbols share their interned name
     case LVAL_SYM:
-      x->sym = malloc(strlen(v->sym) + 1);
-      strcpy(x->sym, v->sym);
+      x->sym = v->sym;
+      x->hash = v->hash;
       break;
-
+    //Copy errors with malloc and strcpy
     case LVAL_ERR:
       x->err = malloc(strlen(v->err) + 1 );
       strcpy(x->err, v->err);
       break;
-    //Copy expressions one element at a time
+    //Copy the cell array, sharing each element
     case LVAL_QEXPR:
     case LVAL_SEXPR:
-      x->count = v->count;
-      x->cell = malloc(sizeof(lval*) * x->count);
+      x->code = NULL;
+      x->slice = 0;
+      x->off = 0;
+      lval_cells(x, v->count);
       for(int i = 0; i < x->count; i++){
-        x->cell[i] = lval_copy(v->cell[i]);
+        x->cell[i] = lval_ref(v->cell[i]);
       }
       break;
+    //Vectors share their trie
+    case LVAL_PVEC:
+      x->start = v->start;
+      x->end = v->end;
+      x->size = v->size;
+      x->shift = v->shift;
+      x->root = lnode_ref(v->root);
+      x->tail = lnode_ref(v->tail);
+      break;
+    case LVAL_NUMS:
+      x->length = v->length;
+      x->data = malloc(sizeof(long) * (v->length > 0 ? v->length : 1));
+      memcpy(x->data, v->data, sizeof(long) * v->length);
+      break;
   }
 
   return x;
 }
 
-lval* lval_call(lenv* e, lval* f, lval* a){
-  //If Builtin then call it
-  if(f->builtin){
-    return f->builtin(e, a);
-  }
-  //Record Argument counts
-  int given = a->count;
-  int total = f->formals->count;
-  //While there are args still to be processed
-  while(a->count){
-    //If there are no more formal args to bind
-    if(f->formals->count == 0){
-      lval_del(a); 
-      return lval_err("Function passed too many args"
-        "Got %i, Expected %i", given, total);
+#ifdef LISPTER_ARENA
+//Move the arena values held under n to the slabs. Nodes are
+//shared, but the promoted values are equal to the old ones
+void lnode_promote(lnode* n, int level){
+  if(!n->dirty){ return; }
+  for(int i = 0; i < VEC_WIDTH; i++){
+    if(level){
+      if(n->kids[i]){ lnode_promote(n->kids[i], level - VEC_BITS); }
+    }else{
+      if(n->vals[i]){ n->vals[i] = lval_promote(n->vals[i]); }
     }
+  }
+  n->dirty = 0;
+}
+#endif
 
-    //Pop first symbol from formals
-    lval* sym = pop(f->formals, 0);
-    //Special Case to deal with '&'
-    if (strcmp(sym->sym, "&") == 0){
-
-      //Ensure & is followed by another symbol
-      if(f->formals->count != 1){
-        lval_del(a);
-        return lval_err("Function format invalid. "
-          "Symbol '&' not followed by single symbol"
-        );
-      }
+//Exchange a reference to v for one to a copy that lives
+//outside the arena. Children are promoted in place, and
+//values already settled outside the arena aren't walked
+//again, so storing one in an env costs nothing
+lval* lval_promote(lval* v){
+  if(LVAL_IS_FIX(v)){ return v; }
+#ifdef LISPTER_ARENA
+  if(v->settled){ return v; }
+  //A slice is moved as a new view of its promoted list rather
+  //than copied cell by cell, so if the list is already
+  //settled it costs the same whatever its length
+  if(arena_owns(v) && (v->type == LVAL_SEXPR || v->type == LVAL_QEXPR) &&
+    v->slice){
+    lval* src = lval_promote(lval_ref(v->src));
+    int depth = arena.depth;
+    arena.depth = 0;
+    lval* x = lval_slice(src, v->cell - v->src->cell, v->count);
+    arena.depth = depth;
+    lval_del(src);
+    lval_del(v);
+    arena.promoted++;
+    x->settled = 1;
+    return x;
+  }
+  if(arena_owns(v)){
+    //Copy with the arena switched off so the copy and any
+    //env it needs come from the slabs
+    int depth = arena.depth;
+    arena.depth = 0;
+    lval* x = lval_copy(v);
+    arena.depth = depth;
+    lval_del(v);
+    v = x;
+    arena.promoted++;
+  }
 
-      //Formals is bound to remaining args
-      lval* newsym = pop(f->formals, 0);
-      lenv_put(f->env, newsym, builtin_list(e,a));
-      lval_del(sym); 
-      lval_del(newsym);
+  switch(v->type){
+    case LVAL_FUN:
+      if(!v->builtin){
+        v->formals = lval_promote(v->formals);
+        //The compiled body points at the body's cells, which
+        //may be moved if it isn't settled
+        if(!v->body->settled){ lval_uncompile(v); }
+        v->body = lval_promote(v->body);
+        if(arena_owns(v->env)){
+          int depth = arena.depth;
+          arena.depth = 0;
+          lenv* n = lenv_copy(v->env);
+          arena.depth = depth;
+          lenv_del(v->env);
+          v->env = n;
+        }
+        //The parent is only set for the duration of a call
+        v->env->parent = NULL;
+        for(int i = 0; i < v->env->capacity; i++){
+          if(v->env->entries[i].sym){
+            v->env->entries[i].val = lval_promote(v->env->entries[i].val);
+          }
+        }
+        for(int i = 0; i < v->env->nslots; i++){
+          if(v->env->slots[i].val){
+            v->env->slots[i].val = lval_promote(v->env->slots[i].val);
+          }
+        }
+      }
+      break;
+    case LVAL_QEXPR:
+    case LVAL_SEXPR:
+      //A slice keeps its place in the promoted list
+      if(v->slice){
+        long at = v->cell - v->src->cell;
+        lval* src = lval_promote(v->src);
+        if(src != v->src){ lval_forget(v); }
+        v->src = src;
+        v->cell = src->cell + at;
+        break;
+      }
+      for(int i = 0; i < v->count; i++){
+        //Code compiled from the list points at its cells and
+        //into the S-Expressions among them, which may move
+        lval* c = v->cell[i];
+        if(!LVAL_IS_FIX(c) && !c->settled &&
+          (arena_owns(c) || c->type == LVAL_SEXPR)){
+          lval_forget(v);
+        }
+        v->cell[i] = lval_promote(c);
+      }
       break;
+    case LVAL_PVEC:
+      lnode_promote(v->root, v->shift);
+      lnode_promote(v->tail, 0);
+      break;
+  }
+  v->settled = 1;
+#endif
+  return v;
+}
+
+//Take another reference to an lval
+lval* lval_ref(lval* v){
+  if(!LVAL_IS_FIX(v)){ v->rc++; }
+  return v;
+}
+
+//Exchange a reference to v for one to an lval that nobody
+//else shares, so it can safely be modified in place.
+//Only copies if v is shared
+lval* lval_own(lval* v){
+  if(LVAL_IS_FIX(v)){ return v; }
+  if(v->rc == 1){
+    //The caller is about to change it, so any code compiled
+    //from it goes stale, and it may be given arena values
+    v->settled = 0;
+    if(v->type == LVAL_SEXPR || v->type == LVAL_QEXPR){
+      lval_forget(v);
+      if(v->slice){ lval_unslice(v); }
     }
+    return v;
+  }
+  lval* x = lval_copy(v);
+  v->rc--;
+  return x;
+}
 
-    //Pop next arg from the list
-    lval* val = pop(a, 0);
+//Put v in one of env's slots
+void lenv_fill(lenv* env, lentry* s, lval* v){
+  v = lval_ref(v);
+#ifdef LISPTER_ARENA
+  if(!arena_owns(env)){ v = lval_promote(v); }
+#endif
+  if(s->val){ lval_del(s->val); }
+  s->val = v;
+}
 
-    //Bind copy into the function env
-    lenv_put(f->env, sym, val);
-    //Delete symbol and value
-    lval_del(sym);
-    lval_del(val);
+//Bind the arguments a to the formals of the lambda f, taking
+//ownership of both. Returns a new env to run f's body in and
+//sets *r to the function to run. If the body can't run yet,
+//returns NULL and sets *r to the error or the partially
+//applied function
+lenv* lval_bind(lenv* e, lval* f, lval* a, lval** r){
+  int given = a->count;
+  int bound = f->env->bound;
+  int amp = f->env->amp;
+  //Formals left before '&', or before the end
+  int plain = (amp < 0 ? f->env->nslots : amp) - bound;
+
+  //If there are more args than formals left
+  if(given > plain && amp < 0){
+    *r = lval_err("Function passed too many args"
+      "Got %i, Expected %i", given, f->formals->count - bound);
+    lval_del(a); lval_del(f);
+    return NULL;
   }
 
-  //Clean up arg list
-  lval_del(a);
-  //if '&' remains in formal list bind to empty list
-  if (f->formals->count > 0 && 
-    strcmp(f->formals->cell[0]->sym, "&")==0){
-    //check that & is not passed invalidly
-    if(f->formals->count != 2){
-      return lval_err("Function format invalid. "
+  //'&' is reached once every plain formal has an arg, and
+  //must be followed by exactly one symbol
+  int full = given >= plain;
+  if(full && amp >= 0 && f->formals->count != amp + 2){
+    lval_del(a); lval_del(f);
+    *r = lval_err("Function format invalid. "
       "Symbol '&' not followed by single symbol");
+    return NULL;
+  }
+
+  //Formals after '&' get a list of the remaining args. Build
+  //it first, as a new env isn't held by anything the
+  //collector can see yet
+  int n = full ? plain : given;
+  lval* rest = NULL;
+  if(full && amp >= 0){
+    rest = lval_qexpr();
+    lval_cells(rest, given - n);
+    for(int i = 0; i < rest->count; i++){
+      rest->cell[i] = lval_ref(a->cell[n + i]);
     }
+  }
+
+  //A full call binds straight into a new env, leaving f alone.
+  //Otherwise the args go into f's own env, so make sure it
+  //isn't shared
+  lenv* env;
+  if(full){
+    env = lenv_copy(f->env);
+  }else{
+    f = lval_own(f);
+    env = f->env;
+  }
 
-    //Pop and delete the symbol '&'
-    lval_del(pop(f->formals, 0));
-    //pop next symbol and create empty list
-    lval* sym = pop(f->formals, 0);
-    lval* val = lval_qexpr();
+  //Args go into the slots in order
+  for(int i = 0; i < n; i++){
+    lenv_fill(env, &env->slots[bound + i], a->cell[i]);
+  }
+  env->bound += n;
+  if(rest){
+    lenv_fill(env, &env->slots[amp], rest);
+    lval_del(rest);
+  }
+
+  lval_del(a);
+  *r = f;
+  //Otherwise return the partially applied function
+  return full ? env : NULL;
+}
 
-    //Bind to env and delete
-    lenv_put(f->env, sym, val);
-    lval_del(sym); lval_del(val);
+//Call f with the arguments a. Takes ownership of both
+lval* lval_call(lenv* e, lval* f, lval* a){
+  //If Builtin then call it
+  if(f->builtin){
+    lval* result = f->builtin(e, a);
+    lval_del(f);
+    return result;
   }
 
-  //if all formals have been bound evaluate
-  if(f->formals->count == 0){
-    //set env parent to evaluation env
-    f->env->parent = e;
-    //Evaluate and return
-    return builtin_eval(f->env, lval_add(lval_sexpr(),
-    lval_copy(f->body)));
-  }else{
-    //Otherwise return partially evaluated func
-    return lval_copy(f);
-  } 
+  lenv* env = lval_bind(e, f, a, &f);
+  if(!env){ return f; }
+
+  //set env parent to evaluation env
+  env->parent = e;
+  env->global = e->local ? e->global : e;
+  return lval_exec(env, f, e);
 }
 
-lval* lval_eq(lval* x, lval* y){
+int lval_eq(lval* x, lval* y){
   //Different types are unequal
-  if(x->type != y->type){
+  if(LVAL_TYPE(x) != LVAL_TYPE(y)){
     return 0;
   }
   //Type based comparison
-  switch(x->type){
+  switch(LVAL_TYPE(x)){
     case LVAL_STR:
       return (strcmp(x->str, y->str) == 0);
       break;
     case LVAL_NUM:
-      return x->num == y->num;
+      return LVAL_NUM_VAL(x) == LVAL_NUM_VAL(y);
       break;
     case LVAL_ERR:
       return (strcmp(x->err, y->err) == 0);
       break;
     case LVAL_SYM:
-      return (strcmp(x->sym, y->sym) == 0);
+      return x->sym == y->sym;
       break;
     //Compare if builtin. Else compare formal and body
     case LVAL_FUN:
@@ -600,7 +1963,7 @@ lval* lval_eq(lval* x, lval* y){
         return x->builtin == y->builtin;
       }
       else{
-        return lval_eq(x->formals, y->formals) && lval_eq(x->body, y->body); 
+        return lval_formals_eq(x, y) && lval_eq(x->body, y->body);
       }
       break;
     case LVAL_SEXPR:
@@ -612,10 +1975,31 @@ lval* lval_eq(lval* x, lval* y){
         }
       }
       return 1;
+    case LVAL_PVEC:
+      if(lval_len(x) != lval_len(y)) return 0;
+      for(int i = 0; i < lval_len(x); i++){
+        if(!lval_eq(lval_nth(x, i), lval_nth(y, i))){
+          return 0;
+        }
+      }
+      return 1;
+    case LVAL_NUMS:
+      if(x->length != y->length) return 0;
+      return memcmp(x->data, y->data, sizeof(long) * x->length) == 0;
   }
   return 0;
 }
 
+//Compare the formals two lambdas have still to bind
+int lval_formals_eq(lval* x, lval* y){
+  int i = x->env->bound, j = y->env->bound;
+  if(x->formals->count - i != y->formals->count - j){ return 0; }
+  for(; i < x->formals->count; i++, j++){
+    if(!lval_eq(x->formals->cell[i], y->formals->cell[j])){ return 0; }
+  }
+  return 1;
+}
+
 lval* builtin_load(lenv* env, lval* a){
   LASSERT_NUM("load", a, 1);
   LASSERT_TYPE("load", a, 0, LVAL_STR);
@@ -628,11 +2012,13 @@ lval* builtin_load(lenv* env, lval* a){
     mpc_ast_delete(r.output);
 
     //Evaluate each expression
-    while(expr->count){
-      lval* x = eval(env, pop(expr, 0));
+    for(int i = 0; i < expr->count; i++){
+      arena_begin();
+      lval* x = eval(env, lval_ref(expr->cell[i]));
       //if error during evaluation, just print it
-      if(x->type == LVAL_ERR){lval_println(x);}
+      if(LVAL_TYPE(x) == LVAL_ERR){lval_println(x);}
       lval_del(x);
+      arena_end();
     }
     //Delete expr and args
     lval_del(expr);
@@ -652,351 +2038,1964 @@ lval* builtin_load(lenv* env, lval* a){
   }
 }
 
-lval* eval(lenv* env, lval* v){
-  if (v->type == LVAL_SYM){
-    lval* x = lenv_get(env, v);
-    lval_del(v);
-    return x;
-  }
-  //Evaluate S-Expression
-  if(v->type == LVAL_SEXPR){
-    return eval_sexpr(env,v);
-  }
-  //All other types of lval remain the same
-  return v;
-}
+//Bytecode.
+//An S-Expression is compiled once into a flat list of stack
+//instructions, cached on the lval and run by lval_run.
+//Operands are resolved while compiling, so constants and
+//symbols are pointers straight into the compiled lval. They
+//don't hold references, so the code is dropped whenever that
+//lval is changed or freed (see lval_forget)
+enum{
+  OP_CONST, //v: push v
+  OP_GET,   //sym entry env version: push the value bound to sym
+  OP_SLOT,  //i: push the value in slot i of the running call's env
+  OP_EMPTY, //push a new empty S-Expression
+  OP_ONE,   //value of a single element S-Expression
+  OP_CALL,  //n: apply the top n values as an S-Expression
+  OP_TAIL,  //n: OP_CALL as the last thing the code does
+  OP_IF,    //then else at end: the builtin 'if' on then and else
+  OP_JMP,   //to: continue at to
+  OP_LAMBDA,//formals body code: the builtin '\' on formals and body
+  OP_VAR,   //syms: the builtin 'def' or '=' on syms and the top values
+  OP_FOLD,  //form i env version end: push fold i of form and go to end
+  OP_RET,   //return the value on top of the stack
+  OP_COUNT
+};
 
-//Extract a single element from an lval list and 
-//shift the rest of the list so that it no longer
-//contains that lval
-lval* pop(lval* v, int i){
-  //The item at i
+//Number of operands that follow each instruction
+int lop_width[OP_COUNT] = {1, 4, 1, 0, 0, 1, 1, 4, 1, 3, 1, 5, 0};
+
+//With GCC and Clang the code is threaded before it first
+//runs: each instruction is replaced by the address of the
+//code in lval_exec that runs it, so dispatching is a single
+//indirect jump. Build with -DLISPTER_NO_THREADING to switch
+//on the opcodes instead
+#if defined(__GNUC__) && !defined(LISPTER_NO_THREADING)
+#define LISPTER_THREADED
+#endif
+
+//A word of code: an instruction, or one of its operands
+typedef union{
+  int op;
+  void* label;
+  int n;
+  lval* v;
+  lentry* entry;
+  lenv* env;
+  long version;
+  lcode* code;
+} lword;
+
+struct lcode{
+  //Lambdas' copies share their compiled body
+  int rc;
+  lword* ops;
+  int count;
+  int capacity;
+  //Set once the instructions have been replaced by labels
+  int threaded;
+  //Set when the lval it was compiled from has changed under
+  //it. Lambdas still sharing it compile their body again
+  int stale;
+  //Stack slots the code needs, and the number of values it
+  //leaves on the stack so far while compiling
+  int depth;
+  int height;
+  //While compiling a lambda body, the env whose slots hold
+  //the formals
+  lenv* frame;
+  //Code compiled for the lambdas this code makes, which it
+  //holds references to
+  lcode** kids;
+  int nkids;
+  //Values of the forms folded by OP_FOLD, or NULL where a
+  //form couldn't be folded. The code holds references to them
+  lval** folds;
+  int nfolds;
+};
+
+lword* lcode_word(lcode* c){
+  if(c->count == c->capacity){
+    c->capacity = c->capacity ? c->capacity * 2 : 16;
+    c->ops = realloc(c->ops, sizeof(lword) * c->capacity);
+  }
+  return &c->ops[c->count++];
+}
+
+void lcode_emit(lcode* c, int op){ lcode_word(c)->n = op; }
+void lcode_emit_val(lcode* c, lval* v){ lcode_word(c)->v = v; }
+
+//Record n values pushed (or popped if negative)
+void lcode_stack(lcode* c, int n){
+  c->height += n;
+  if(c->height > c->depth){ c->depth = c->height; }
+}
+
+void lcode_expr(lcode* c, lval* v);
+
+//Check that v is a Q-Expression of symbols only
+int lval_syms(lval* v){
+  if(LVAL_TYPE(v) != LVAL_QEXPR){ return 0; }
+  for(int i = 0; i < v->count; i++){
+    if(LVAL_TYPE(v->cell[i]) != LVAL_SYM){ return 0; }
+  }
+  return 1;
+}
+
+//(\ {formals} {body}) makes the lambda straight from the two
+//Q-Expressions, without an argument list. Like 'if', if '\'
+//isn't the builtin when it runs it's called as usual
+int lcode_lambda(lcode* c, lval* v){
+  if(v->count != 3 || LVAL_TYPE(v->cell[0]) != LVAL_SYM ||
+    v->cell[0]->sym != lsym_lambda() || !lval_syms(v->cell[1]) ||
+    LVAL_TYPE(v->cell[2]) != LVAL_QEXPR){
+    return 0;
+  }
+  lcode_expr(c, v->cell[0]);
+  lcode_stack(c, 2);
+  lcode_stack(c, -2);
+  lcode_emit(c, OP_LAMBDA);
+  lcode_emit_val(c, v->cell[1]);
+  lcode_emit_val(c, v->cell[2]);
+  lcode_word(c)->code = NULL;
+  return 1;
+}
+
+//(def {syms} vals) and (= {syms} vals) bind the values
+//without building an argument list, when there is a value
+//for each symbol
+int lcode_var(lcode* c, lval* v){
+  if(v->count < 2 || LVAL_TYPE(v->cell[0]) != LVAL_SYM ||
+    (v->cell[0]->sym != lsym_def() && v->cell[0]->sym != lsym_put()) ||
+    !lval_syms(v->cell[1]) || v->cell[1]->count != v->count - 2){
+    return 0;
+  }
+  lcode_expr(c, v->cell[0]);
+  for(int i = 2; i < v->count; i++){
+    lcode_expr(c, v->cell[i]);
+  }
+  //The symbols are pushed under the values if it's called
+  lcode_stack(c, 1);
+  lcode_stack(c, -(v->count - 1));
+  lcode_emit(c, OP_VAR);
+  lcode_emit_val(c, v->cell[1]);
+  return 1;
+}
+
+//Check that v is a call to a builtin without side effects
+//on constants, or on other such calls. Whether the symbols
+//really name those builtins is only known when it runs
+int lcode_foldable(lcode* c, lval* v){
+  if(v->count < 2 || LVAL_TYPE(v->cell[0]) != LVAL_SYM ||
+    !LSYM(v->cell[0]->sym)->pure ||
+    (c->frame && lenv_slot(c->frame, v->cell[0]->sym))){
+    return 0;
+  }
+  for(int i = 1; i < v->count; i++){
+    switch(LVAL_TYPE(v->cell[i])){
+      case LVAL_NUM:
+      case LVAL_STR:
+      case LVAL_QEXPR:
+        break;
+      case LVAL_SEXPR:
+        if(!lcode_foldable(c, v->cell[i])){ return 0; }
+        break;
+      default:
+        return 0;
+    }
+  }
+  return 1;
+}
+
+//Compile the cells of v as an S-Expression. If tail is set
+//its value is what the code returns
+void lcode_list(lcode* c, lval* v, int tail){
+  if(v->count == 0){
+    lcode_emit(c, OP_EMPTY);
+    lcode_stack(c, 1);
+    return;
+  }
+
+  if(v->count == 1){
+    lcode_expr(c, v->cell[0]);
+    lcode_emit(c, OP_ONE);
+    return;
+  }
+
+  //(if cond {then} {else}) jumps straight into the branch it
+  //takes. If 'if' turns out not to be the builtin when run,
+  //the branches are pushed and it's called like any function
+  if(v->count == 4 && LVAL_TYPE(v->cell[0]) == LVAL_SYM &&
+    v->cell[0]->sym == lsym_if() &&
+    LVAL_TYPE(v->cell[2]) == LVAL_QEXPR &&
+    LVAL_TYPE(v->cell[3]) == LVAL_QEXPR){
+    lcode_expr(c, v->cell[0]);
+    lcode_expr(c, v->cell[1]);
+    lcode_stack(c, 2);
+    lcode_stack(c, -4);
+
+    lcode_emit(c, OP_IF);
+    lcode_emit_val(c, v->cell[2]);
+    lcode_emit_val(c, v->cell[3]);
+    int at = c->count;
+    lcode_emit(c, 0);
+    lcode_emit(c, 0);
+
+    lcode_list(c, v->cell[2], tail);
+    lcode_emit(c, OP_JMP);
+    int jmp = c->count;
+    lcode_emit(c, 0);
+
+    c->ops[at].n = c->count;
+    lcode_stack(c, -1);
+    lcode_list(c, v->cell[3], tail);
+    c->ops[at+1].n = c->count;
+    c->ops[jmp].n = c->count;
+    return;
+  }
+
+  if(lcode_lambda(c, v) || lcode_var(c, v)){ return; }
+
+  //A call that can be folded skips straight to its value
+  //once it's known, and otherwise runs as usual
+  int at = -1;
+  if(lcode_foldable(c, v)){
+    lcode_emit(c, OP_FOLD);
+    lcode_emit_val(c, v);
+    lcode_emit(c, c->nfolds);
+    lcode_word(c)->env = NULL;
+    lcode_word(c)->version = 0;
+    at = c->count;
+    lcode_emit(c, 0);
+    c->folds = realloc(c->folds, sizeof(lval*) * (c->nfolds + 1));
+    c->folds[c->nfolds++] = NULL;
+  }
+
+  for(int i = 0; i < v->count; i++){
+    lcode_expr(c, v->cell[i]);
+  }
+  lcode_emit(c, tail ? OP_TAIL : OP_CALL);
+  lcode_emit(c, v->count);
+  lcode_stack(c, 1 - v->count);
+  if(at >= 0){ c->ops[at].n = c->count; }
+}
+
+//Compile code that pushes the value of v
+void lcode_expr(lcode* c, lval* v){
+  switch(LVAL_TYPE(v)){
+    //A lambda's own formals are always bound in the env its
+    //body runs in, at the same slot. Anything else depends on
+    //the caller, so it is looked up by name
+    case LVAL_SYM: {
+      lentry* e = c->frame ? lenv_slot(c->frame, v->sym) : NULL;
+      if(e){
+        lcode_emit(c, OP_SLOT);
+        lcode_emit(c, e - c->frame->slots);
+      }else{
+        //Room to cache where the symbol was found
+        lcode_emit(c, OP_GET);
+        lcode_emit_val(c, v);
+        lcode_word(c)->entry = NULL;
+        lcode_word(c)->env = NULL;
+        lcode_word(c)->version = 0;
+      }
+      break;
+    }
+    case LVAL_SEXPR:
+      lcode_list(c, v, 0);
+      return;
+    //All other types of lval evaluate to themselves
+    default:
+      lcode_emit(c, OP_CONST);
+      lcode_emit_val(c, v);
+      break;
+  }
+  lcode_stack(c, 1);
+}
+
+lcode* lcode_ref(lcode* c){
+  if(c){ c->rc++; }
+  return c;
+}
+
+void lcode_del(lcode* c){
+  if(!c || --c->rc > 0){ return; }
+  for(int i = 0; i < c->nkids; i++){ lcode_del(c->kids[i]); }
+  free(c->kids);
+  for(int i = 0; i < c->nfolds; i++){
+    if(c->folds[i]){ lval_del(c->folds[i]); }
+  }
+  free(c->folds);
+  free(c->ops);
+  free(c);
+}
+
+//Drop the code compiled from the body of the lambda f. Other
+//lambdas may share it, so it's marked stale for them too
+void lval_uncompile(lval* f){
+  if(!f->compiled){ return; }
+  f->compiled->stale = 1;
+  lcode_del(f->compiled);
+  f->compiled = NULL;
+}
+
+//Drop any code compiled from v
+void lval_forget(lval* v){
+  lcode_del(v->code);
+  v->code = NULL;
+}
+
+//Values being worked on by running code
+struct{
+  lval** vals;
+  int count;
+  int capacity;
+} vm;
+
+//Check the values of an S-Expression's elements before they
+//are applied, taking ownership of them. Returns an error, or
+//NULL with the arguments moved into a new list *a
+lval* lval_args(lval** v, int n, lval** a){
+  //Check for errors
+  for(int i = 0; i < n; i++){
+    if(LVAL_TYPE(v[i]) == LVAL_ERR){
+      lval* err = v[i];
+      for(int j = 0; j < n; j++){
+        if(j != i){ lval_del(v[j]); }
+      }
+      return err;
+    }
+  }
+
+  //Check first element is function after evaluation
+  lval* f = v[0];
+  if(LVAL_TYPE(f) != LVAL_FUN){
+    lval* err = lval_err(
+      "S-Expression Starts with incorrect type."
+      "Got %s, Expected %s ", 
+      ltype_name(LVAL_TYPE(f)), ltype_name(LVAL_FUN)
+      );
+    for(int i = 0; i < n; i++){ lval_del(v[i]); }
+    return err;
+  }
+
+  //The rest are the arguments. They are moved off the stack
+  //before the call can reuse it
+  *a = lval_sexpr();
+  lval_cells(*a, n - 1);
+  memcpy((*a)->cell, v + 1, sizeof(lval*) * (*a)->count);
+  return NULL;
+}
+
+//Most args a fast entry is called with
+#define FAST_ARGS 3
+
+//Call the builtin v[0] through its fast entry, if it has one
+//that takes the args v[1..n-1]. Returns NULL if not
+lval* lval_fast(lval** v, int n){
+  lval* f = v[0];
+  if(LVAL_TYPE(f) != LVAL_FUN || !f->builtin || !f->fast ||
+    n - 1 > FAST_ARGS){
+    return NULL;
+  }
+  lval* x = f->fast(v + 1, n - 1);
+  if(!x){ return NULL; }
+  for(int i = 0; i < n; i++){ lval_del(v[i]); }
+  return x;
+}
+
+//Apply the values of an S-Expression's elements, taking
+//ownership of them
+lval* lval_apply(lenv* env, lval** v, int n){
+  lval* x = lval_fast(v, n);
+  if(x){ return x; }
+  lval* a;
+  lval* err = lval_args(v, n, &a);
+  if(err){ return err; }
+  return lval_call(env, v[0], a);
+}
+
+//Call f with n args, borrowing f and the args. Builtins go
+//through their fast entry when they have one. Lambdas bind
+//the args from *l, which the caller keeps between calls and
+//releases with lval_del, so calling f for each element of a
+//list doesn't build a new argument list every time
+lval* lval_call_with(lenv* env, lval* f, lval** args, int n, lval** l){
+  if(f->builtin){
+    if(f->fast && n <= FAST_ARGS){
+      lval* x = f->fast(args, n);
+      if(x){ return x; }
+    }
+    //Builtins take their arguments apart, so they get their
+    //own list
+    lval* a = lval_sexpr();
+    lval_cells(a, n);
+    for(int i = 0; i < n; i++){ a->cell[i] = lval_ref(args[i]); }
+    return f->builtin(env, a);
+  }
+
+  if(!*l){
+    *l = lval_sexpr();
+    lval_cells(*l, n);
+  }
+  lval* a = *l;
+  a->count = n;
+  for(int i = 0; i < n; i++){ a->cell[i] = lval_ref(args[i]); }
+
+  //Binding only takes references to the args, so once it's
+  //done with the list they can be dropped and the list reused
+  lval* g = lval_ref(f);
+  lenv* frame = lval_bind(env, g, lval_ref(a), &g);
+  for(int i = 0; i < n; i++){ lval_del(a->cell[i]); }
+  a->count = 0;
+  if(!frame){ return g; }
+  frame->parent = env;
+  frame->global = env->local ? env->global : env;
+  return lval_exec(frame, g, env);
+}
+
+//Check whether env binds sym itself
+int lenv_binds(lenv* env, char* sym, unsigned long hash){
+  lentry* s = lenv_slot(env, sym);
+  if(s){ return s->val != NULL; }
+  return env->count && lenv_find(env, sym, hash)->sym;
+}
+
+//Check whether every symbol bound in b is also bound in a
+int lenv_covers(lenv* a, lenv* b){
+  for(int i = 0; i < b->capacity; i++){
+    lentry* e = &b->entries[i];
+    if(e->sym && !lenv_binds(a, e->sym, e->hash)){ return 0; }
+  }
+  for(int i = 0; i < b->nslots; i++){
+    lentry* e = &b->slots[i];
+    if(e->val && e->sym && !lenv_binds(a, e->sym, e->hash)){ return 0; }
+  }
+  return 1;
+}
+
+//Make room on the stack for the code c
+void vm_reserve(lcode* c){
+  if(vm.count + c->depth <= vm.capacity){ return; }
+  while(vm.count + c->depth > vm.capacity){
+    vm.capacity = vm.capacity ? vm.capacity * 2 : 256;
+  }
+  vm.vals = realloc(vm.vals, sizeof(lval*) * vm.capacity);
+}
+
+//Compiled code for the cells of v as an S-Expression, or for
+//the body of v if it's a lambda
+lcode* lval_code(lval* v){
+  if(v->type == LVAL_FUN){
+    if(v->compiled && v->compiled->stale){ lval_uncompile(v); }
+    if(!v->compiled){
+      v->compiled = calloc(1, sizeof(lcode));
+      v->compiled->rc = 1;
+      v->compiled->frame = v->env;
+      lcode_list(v->compiled, v->body, 1);
+      lcode_emit(v->compiled, OP_RET);
+      v->compiled->frame = NULL;
+    }
+    return v->compiled;
+  }
+  if(!v->code){
+    v->code = calloc(1, sizeof(lcode));
+    v->code->rc = 1;
+    lcode_list(v->code, v, 1);
+    lcode_emit(v->code, OP_RET);
+  }
+  return v->code;
+}
+
+//Look k up for an OP_GET, and if it's bound in the global
+//env and nothing local can shadow it, remember the entry in
+//the words following the instruction
+lval* lenv_get_cached(lenv* env, lval* k, lword* cache){
+  lenv* g = env->global ? env->global : env;
+  if(LSYM(k->sym)->shadows == 0 && !g->local && g->count){
+    lentry* e = lenv_find(g, k->sym, k->hash);
+    if(e->sym){
+      cache[0].entry = e;
+      cache[1].env = g;
+      cache[2].version = lenv_version;
+      return lval_ref(e->val);
+    }
+  }
+  return lenv_get(env, k);
+}
+
+//Check whether a call in the folded form v could now see a
+//local binding in place of the builtin
+int lval_fold_shadowed(lval* v){
+  if(LSYM(v->cell[0]->sym)->shadows){ return 1; }
+  for(int i = 1; i < v->count; i++){
+    if(LVAL_TYPE(v->cell[i]) == LVAL_SEXPR &&
+      lval_fold_shadowed(v->cell[i])){
+      return 1;
+    }
+  }
+  return 0;
+}
+
+//The value of the form v checked by lcode_foldable, or NULL
+//if one of its symbols isn't bound to a builtin without side
+//effects or a call fails. Errors are left for the code that
+//didn't fold to make, as it would have
+lval* lval_fold(lenv* env, lval* v){
+  lval** vals = malloc(sizeof(lval*) * v->count);
+  vals[0] = lenv_get(env, v->cell[0]);
+  int n = 1;
+  if(lval_pure(vals[0])){
+    for(; n < v->count; n++){
+      lval* x = v->cell[n];
+      x = LVAL_TYPE(x) == LVAL_SEXPR ? lval_fold(env, x) : lval_ref(x);
+      if(!x){ break; }
+      vals[n] = x;
+    }
+  }
+  lval* r = NULL;
+  if(n == v->count){
+    r = lval_apply(env, vals, n);
+    if(LVAL_TYPE(r) == LVAL_ERR){
+      lval_del(r);
+      r = NULL;
+    }
+  }else{
+    for(int i = 0; i < n; i++){ lval_del(vals[i]); }
+  }
+  free(vals);
+  return r;
+}
+
+//Replace the instructions of c by the labels that run them
+void lcode_thread(lcode* c, void** labels){
+  int pc = 0;
+  while(pc < c->count){
+    int op = c->ops[pc].op;
+    c->ops[pc].label = labels[op];
+    pc += 1 + lop_width[op];
+  }
+  c->threaded = 1;
+}
+
+//Evaluate the cells of v as an S-Expression in env, or the
+//body of v if it's a lambda and env was bound by lval_bind.
+//Calls to lambdas in tail position carry on in this loop
+//with a new env instead of nesting, so loops run in constant
+//C stack. The envs between env and base, and v if env isn't
+//base, belong to the loop and are released when it's done
+//An error ends the whole evaluation as soon as it's made,
+//since every call waiting on it would just return it
+lval* lval_exec(lenv* env, lval* v, lenv* base){
+#ifdef LISPTER_THREADED
+  static void* labels[OP_COUNT] = {&&do_const, &&do_get, &&do_slot,
+    &&do_empty, &&do_one, &&do_call, &&do_tail, &&do_if, &&do_jmp,
+    &&do_lambda, &&do_var, &&do_fold, &&do_ret};
+  #define VM_CASE(op, label) label:
+  #define VM_NEXT goto *ops[pc++].label
+  #define VM_THREAD(c) if(!(c)->threaded){ lcode_thread(c, labels); }
+#else
+  #define VM_CASE(op, label) case op:
+  #define VM_NEXT break
+  #define VM_THREAD(c)
+#endif
+  #define VM_CHECK(x) if(LVAL_TYPE(x) == LVAL_ERR){ goto fail; }
+#ifdef LISPTER_GC
+  lenv* frame = gc.frame;
+  gc.frame = env;
+#endif
+  lcode* c = lval_code(v);
+  vm_reserve(c);
+  VM_THREAD(c);
+
+  //Values below sp belong to whoever is running this code
+  int sp = vm.count;
+  lword* ops = c->ops;
+  int pc = 0;
+#ifdef LISPTER_THREADED
+  VM_NEXT;
+#else
+  for(;;) switch(ops[pc++].op){
+#endif
+    VM_CASE(OP_CONST, do_const)
+      vm.vals[vm.count++] = lval_ref(ops[pc++].v);
+      VM_NEXT;
+
+    //Globals are read straight from the entry they were last
+    //found in, while the global env is the same and unchanged
+    //and nothing local can shadow them
+    VM_CASE(OP_GET, do_get){
+      lval* k = ops[pc].v;
+      lenv* g = env->global ? env->global : env;
+      if(ops[pc+2].env == g && ops[pc+3].version == lenv_version &&
+        LSYM(k->sym)->shadows == 0){
+        vm.vals[vm.count++] = lval_ref(ops[pc+1].entry->val);
+      }else{
+        lval* x = lenv_get_cached(env, k, &ops[pc+1]);
+        vm.vals[vm.count++] = x;
+        VM_CHECK(x);
+      }
+      pc += 4;
+      VM_NEXT;
+    }
+
+    VM_CASE(OP_SLOT, do_slot)
+      vm.vals[vm.count++] = lval_ref(env->slots[ops[pc++].n].val);
+      VM_NEXT;
+
+    VM_CASE(OP_EMPTY, do_empty)
+      vm.vals[vm.count++] = lval_sexpr();
+      VM_NEXT;
+
+    //A single element evaluates to its value, which is
+    //evaluated again if that is itself an expression
+    VM_CASE(OP_ONE, do_one){
+      lval* x = vm.vals[vm.count-1];
+      if(LVAL_TYPE(x) == LVAL_SYM ||
+        (LVAL_TYPE(x) == LVAL_SEXPR && x->count)){
+        vm.count--;
+        x = eval(env, x);
+        vm.vals[vm.count++] = x;
+        VM_CHECK(x);
+      }
+      VM_NEXT;
+    }
+
+    VM_CASE(OP_CALL, do_call){
+      int n = ops[pc++].n;
+      vm.count -= n;
+      lval* x = lval_apply(env, &vm.vals[vm.count], n);
+      vm.vals[vm.count++] = x;
+      VM_CHECK(x);
+      VM_NEXT;
+    }
+
+    VM_CASE(OP_IF, do_if){
+      lval* f = vm.vals[vm.count-2];
+      lval* x = vm.vals[vm.count-1];
+      if(LVAL_TYPE(f) == LVAL_FUN && f->builtin == builtin_if &&
+        LVAL_TYPE(x) == LVAL_NUM){
+        long cond = LVAL_NUM_VAL(x);
+        vm.count -= 2;
+        lval_del(f);
+        lval_del(x);
+        pc = cond ? pc + 4 : ops[pc+2].n;
+      }else{
+        vm.vals[vm.count++] = lval_ref(ops[pc].v);
+        vm.vals[vm.count++] = lval_ref(ops[pc+1].v);
+        vm.count -= 4;
+        lval* r = lval_apply(env, &vm.vals[vm.count], 4);
+        vm.vals[vm.count++] = r;
+        VM_CHECK(r);
+        pc = ops[pc+3].n;
+      }
+      VM_NEXT;
+    }
+
+    VM_CASE(OP_TAIL, do_tail){
+      int n = ops[pc++].n;
+      vm.count -= n;
+      lval* f = vm.vals[vm.count];
+      lval* x = lval_fast(&vm.vals[vm.count], n);
+      if(x){
+        vm.vals[vm.count++] = x;
+        VM_NEXT;
+      }
+      lval* a;
+      x = lval_args(&vm.vals[vm.count], n, &a);
+      if(!x && f->builtin){ x = lval_call(env, f, a); }
+      if(x){
+        vm.vals[vm.count++] = x;
+        VM_NEXT;
+      }
+
+      lenv* next = lval_bind(env, f, a, &f);
+      if(!next){
+        vm.vals[vm.count++] = f;
+        VM_NEXT;
+      }
+
+      //The current env is kept under the new one only if
+      //the callee could see some of its bindings
+      next->global = env->local ? env->global : env;
+      if(env != base && lenv_covers(next, env)){
+        next->parent = env->parent;
+        lenv_del(env);
+      }else{
+        next->parent = env;
+      }
+      if(env != base){ lval_del(v); }
+      env = next;
+      v = f;
+#ifdef LISPTER_GC
+      gc.frame = env;
+#endif
+
+      c = lval_code(v);
+      vm_reserve(c);
+      VM_THREAD(c);
+      ops = c->ops;
+      pc = 0;
+      VM_NEXT;
+    }
+
+    VM_CASE(OP_JMP, do_jmp)
+      pc = ops[pc].n;
+      VM_NEXT;
+
+    //The lambdas made here share the body compiled for the
+    //first of them
+    VM_CASE(OP_LAMBDA, do_lambda){
+      lval* f = vm.vals[vm.count-1];
+      if(LVAL_TYPE(f) == LVAL_FUN && f->builtin == builtin_lambda){
+        lval_del(f);
+        lval* x = lval_lambda(lval_ref(ops[pc].v), lval_ref(ops[pc+1].v));
+        if(ops[pc+2].code && !ops[pc+2].code->stale){
+          x->compiled = lcode_ref(ops[pc+2].code);
+        }else{
+          //Stale code is swapped for the new code in place
+          lcode* old = ops[pc+2].code;
+          ops[pc+2].code = lcode_ref(lval_code(x));
+          int k = 0;
+          while(k < c->nkids && c->kids[k] != old){ k++; }
+          if(k == c->nkids){
+            c->kids = realloc(c->kids, sizeof(lcode*) * (c->nkids + 1));
+            c->nkids++;
+          }else{
+            lcode_del(old);
+          }
+          c->kids[k] = ops[pc+2].code;
+        }
+        vm.vals[vm.count-1] = x;
+      }else{
+        vm.vals[vm.count++] = lval_ref(ops[pc].v);
+        vm.vals[vm.count++] = lval_ref(ops[pc+1].v);
+        vm.count -= 3;
+        lval* r = lval_apply(env, &vm.vals[vm.count], 3);
+        vm.vals[vm.count++] = r;
+        VM_CHECK(r);
+      }
+      pc += 3;
+      VM_NEXT;
+    }
+
+    VM_CASE(OP_VAR, do_var){
+      lval* syms = ops[pc++].v;
+      int n = syms->count;
+      vm.count -= n + 1;
+      lval* f = vm.vals[vm.count];
+      lval** vals = &vm.vals[vm.count + 1];
+      lbind bind = NULL;
+      if(LVAL_TYPE(f) == LVAL_FUN){
+        if(f->builtin == builtin_def){ bind = lenv_def; }
+        if(f->builtin == builtin_put){ bind = lenv_put; }
+      }
+      if(!bind){
+        memmove(vals + 1, vals, sizeof(lval*) * n);
+        vals[0] = lval_ref(syms);
+        lval* r = lval_apply(env, &vm.vals[vm.count], n + 2);
+        vm.vals[vm.count++] = r;
+        VM_CHECK(r);
+        VM_NEXT;
+      }
+      //Nothing is bound if a value is an error
+      lval* x = NULL;
+      for(int i = 0; i < n && !x; i++){
+        if(LVAL_TYPE(vals[i]) == LVAL_ERR){ x = lval_ref(vals[i]); }
+      }
+      for(int i = 0; i < n; i++){
+        if(!x){ bind(env, syms->cell[i], vals[i]); }
+        lval_del(vals[i]);
+      }
+      lval_del(f);
+      if(x){
+        vm.vals[vm.count++] = x;
+        goto fail;
+      }
+      vm.vals[vm.count++] = lval_sexpr();
+      VM_NEXT;
+    }
+
+    //A folded form's value is used while the global env is
+    //the same and unchanged and nothing local shadows its
+    //builtins. It's worked out again after any change
+    VM_CASE(OP_FOLD, do_fold){
+      lval* x = ops[pc].v;
+      int i = ops[pc+1].n;
+      lenv* g = env->global ? env->global : env;
+      if(lval_fold_shadowed(x)){
+        pc += 5;
+        VM_NEXT;
+      }
+      if(ops[pc+2].env != g || ops[pc+3].version != lenv_version){
+        if(c->folds[i]){ lval_del(c->folds[i]); }
+        lval* r = lval_fold(env, x);
+        //The code outlives the top-level form being run
+        c->folds[i] = r ? lval_promote(r) : NULL;
+        ops[pc+2].env = g;
+        ops[pc+3].version = lenv_version;
+      }
+      if(c->folds[i]){
+        vm.vals[vm.count++] = lval_ref(c->folds[i]);
+        pc = ops[pc+4].n;
+      }else{
+        pc += 5;
+      }
+      VM_NEXT;
+    }
+
+    VM_CASE(OP_RET, do_ret)
+      goto done;
+#ifndef LISPTER_THREADED
+  }
+#endif
+  #undef VM_CASE
+  #undef VM_NEXT
+  #undef VM_THREAD
+  #undef VM_CHECK
+
+  //Drop everything still waiting on the error and leave it as
+  //the result
+fail:;
+  lval* err = vm.vals[--vm.count];
+  while(vm.count > sp){ lval_del(vm.vals[--vm.count]); }
+  vm.vals[vm.count++] = err;
+
+done:;
+  lval* result = vm.vals[--vm.count];
+  if(env != base){ lval_del(v); }
+  while(env != base){
+    lenv* parent = env->parent;
+    lenv_del(env);
+    env = parent;
+  }
+#ifdef LISPTER_GC
+  gc.frame = frame;
+#endif
+  return result;
+}
+
+//Evaluate the cells of v as an S-Expression. v itself isn't
+//changed, so a Q-Expression can be run without converting it
+lval* lval_run(lenv* env, lval* v){
+  return lval_exec(env, v, env);
+}
+
+lval* eval(lenv* env, lval* v){
+  if (LVAL_TYPE(v) == LVAL_SYM){
+    lval* x = lenv_get(env, v);
+    lval_del(v);
+    return x;
+  }
+  //Evaluate S-Expression
+  if(LVAL_TYPE(v) == LVAL_SEXPR && v->count){
+    lval* x = lval_run(env, v);
+    lval_del(v);
+    return x;
+  }
+  //All other types of lval remain the same
+  return v;
+}
+
+//Extract a single element from an lval list and 
+//shift the rest of the list so that it no longer
+//contains that lval. The list must not be shared
+lval* pop(lval* v, int i){
+  //The item at i
   lval* x = v->cell[i];
+  v->count--;
+
+  //Popping the first item just moves the start of the list
+  if(i == 0){
+    v->cell++;
+    v->off++;
+    v->capacity--;
+    return x;
+  }
 
   //Shift memory after the item at "i" over the top
   memmove(&v->cell[i], &v->cell[i+1],
-    sizeof(lval*) * (v->count-i-1)
+    sizeof(lval*) * (v->count-i)
   );
 
-  v->count--;
+  return x;
+
+}
+//Similar to pop but it deletes the list 
+//it has extracted the value from. The list
+//may be shared, so it's left intact
+lval* take(lval* v, int i){
+  lval* x = lval_ref(v->cell[i]);
+  lval_del(v);
+  return x;
+}
+
+//Overflow wraps around, the same as in the vector kernels
+long op_neg(long x){ return (long)-(unsigned long)x; }
+int op_add(long* x, long y){ *x = (long)((unsigned long)*x + (unsigned long)y); return 1; }
+int op_sub(long* x, long y){ *x = (long)((unsigned long)*x - (unsigned long)y); return 1; }
+int op_mul(long* x, long y){ *x = (long)((unsigned long)*x * (unsigned long)y); return 1; }
+int op_div(long* x, long y){
+  if(y == 0){ return 0; }
+  *x = y == -1 ? op_neg(*x) : *x / y;
+  return 1;
+}
+int op_mod(long* x, long y){
+  if(y == 0){ return 0; }
+  *x = y == -1 ? 0 : *x % y;
+  return 1;
+}
+
+//Builtin operator function. op names it in errors and k
+//does the arithmetic
+lval* builtin_op(lenv* env, lval* a, char* op, lop k){
+  //Make sure all arguments are numbers
+  for(int i = 0; i < a->count; i++){
+    if(LVAL_TYPE(a->cell[i]) != LVAL_NUM){
+      lval* err = lval_err("Function '%s' passed incorrect type for argument 1."
+      "Got %s. Expected %s",op, ltype_name(LVAL_TYPE(a->cell[i])),ltype_name(LVAL_NUM));
+      lval_del(a);
+      return err;
+    }
+  }
+
+  //Work on plain longs so fixnum arithmetic never allocates
+  long x = LVAL_NUM_VAL(a->cell[0]);
+
+  //If there are no arguments and substraction we 
+  //do unary negation
+  if(k == op_sub && a->count == 1){
+    x = op_neg(x);
+  }
+
+  //While there are more elements remaining
+  for(int i = 1; i < a->count; i++){
+    if(!k(&x, LVAL_NUM_VAL(a->cell[i]))){
+      lval_del(a);
+      return lval_err_common(LERR_DIV_ZERO);
+    }
+  }
+
+  lval_del(a); return lval_num(x);
+
+}
+
+//Fast arithmetic on fixnums. Anything else, and division by
+//zero, is left to builtin_op
+lval* fast_op(lval** v, int n, lop k){
+  for(int i = 0; i < n; i++){
+    if(!LVAL_IS_FIX(v[i])){ return NULL; }
+  }
+  long x = LVAL_FIX_VAL(v[0]);
+  if(k == op_sub && n == 1){ x = op_neg(x); }
+  for(int i = 1; i < n; i++){
+    if(!k(&x, LVAL_FIX_VAL(v[i]))){ return NULL; }
+  }
+  return lval_num(x);
+}
+
+char* ltype_name(int t){
+  switch(t){
+    case LVAL_STR:
+      return "String";
+    case LVAL_FUN: 
+      return "Function";
+    case LVAL_NUM:
+      return "Number";
+    case LVAL_ERR:
+      return "Error";
+    case LVAL_SYM:
+      return "Symbol";
+    case LVAL_QEXPR:
+      return "Q-Expression";
+    case LVAL_SEXPR:
+      return "S-Expression";
+    case LVAL_PVEC:
+      return "Vector";
+    case LVAL_NUMS:
+      return "Numeric Vector";
+    default:
+      return "Unknown";
+  }
+}
+
+
+lval* builtin_lambda(lenv* e, lval* a){
+  //Check 2 arguments, each of which is
+  //a q-expression
+  LASSERT_NUM("\\", a, 2);
+  LASSERT_TYPE("\\", a, 0, LVAL_QEXPR);
+  LASSERT_TYPE("\\", a, 1, LVAL_QEXPR);
+
+  //Check first Q-expression contains symbols only
+  for(int i = 0; i < a->cell[0]->count; i++){
+    LASSERT(a, (LVAL_TYPE(a->cell[0]->cell[i]) == LVAL_SYM),
+      "Can't define non-symbol. Got %s, Expected %s",
+      ltype_name(LVAL_TYPE(a->cell[0]->cell[i])),ltype_name(LVAL_SYM));
+  }
+
+  //pop the first 2 arguments and create an lval_lambda
+  lval* formals = pop(a,0);
+  lval* body = pop(a, 0);
+  lval_del(a);
+  return lval_lambda(formals, body);
+}
+
+lval* builtin_head(lenv* env,lval* a){
+  //Error checking
+  LASSERT(a, a->count == 1, 
+    "Too many arguments passed to function 'head'. "
+    "Got %i, Expected %i.", a->count,1);
+  //A vector's head is a vector of its first element
+  if(LVAL_TYPE(a->cell[0]) == LVAL_PVEC){
+    LASSERT_COMMON(a, lval_len(a->cell[0]) != 0, LERR_HEAD_EMPTY_VEC);
+    return pvec_slice(take(a, 0), 0, 1);
+  }
+  LASSERT(a, LVAL_TYPE(a->cell[0]) == LVAL_QEXPR,
+  "Function head passed incorrect type. "
+  "Got a %s, Expected %s", 
+    ltype_name(LVAL_TYPE(a->cell[0])), ltype_name(LVAL_QEXPR) );
+
+  LASSERT_COMMON(a, a->cell[0]->count != 0, LERR_HEAD_EMPTY);
+  //Otherwise make a list of the first element
+  lval* v = lval_add(lval_qexpr(), lval_ref(a->cell[0]->cell[0]));
+  lval_del(a);
+  return v;
+}
+
+lval* builtin_tail(lenv* env,lval* a){
+  //Check for errors
+  LASSERT(a, a->count == 1, 
+    "'Tail' passed too many args."
+    "Got %i, Expected %i.", a->count,1);
+
+  //A vector's tail views the same trie
+  if(LVAL_TYPE(a->cell[0]) == LVAL_PVEC){
+    LASSERT_COMMON(a, lval_len(a->cell[0]) != 0, LERR_TAIL_EMPTY_VEC);
+    lval* v = take(a, 0);
+    return pvec_slice(v, 1, lval_len(v));
+  }
+
+  LASSERT(a, LVAL_TYPE(a->cell[0]) == LVAL_QEXPR,
+    "'Tail' passed the wrong types."
+    "Got a %s, Expected %s", 
+    ltype_name(LVAL_TYPE(a->cell[0])), ltype_name(LVAL_QEXPR));
+
+  LASSERT_COMMON(a, a->cell[0]->count != 0, LERR_TAIL_EMPTY);
+  //Take first argument
+  lval* v = take(a,0);
+  //Drop the first element in place if nothing else holds the
+  //list, otherwise view the rest of it
+  if(v->rc == 1 && !v->slice){
+    lval_forget(v);
+    lval_del(pop(v,0));
+    return v;
+  }
+  lval* x = lval_slice(v, 1, v->count - 1);
+  lval_del(v);
+  return x;
+}
+
+lval* builtin_list(lenv* env,lval* a){
+  a = lval_own(a);
+  a->type = LVAL_QEXPR;
+  return a;
+}
+
+lval* builtin_eval(lenv* env,lval* a){
+  LASSERT(a, a->count == 1, 
+    "Function 'eval' passed too many arguments!"
+    "Got %i, Expected %i.", a->count,1);
+  LASSERT(a, LVAL_TYPE(a->cell[0]) == LVAL_QEXPR, 
+    "Function 'eval' passed incorrect type!"
+    "Got a %s, Expected %s", 
+    ltype_name(LVAL_TYPE(a->cell[0])), ltype_name(LVAL_QEXPR));
+
+  //Run the list as code without converting or copying it
+  lval* x = lval_run(env, a->cell[0]);
+  lval_del(a);
+  return x;
+}
+
+lval* lval_join(lval* x, lval* y){
+  //Add each element when either side is a vector
+  if(x->type == LVAL_PVEC || y->type == LVAL_PVEC){
+    for(int i = 0; i < lval_len(y); i++){
+      lval* e = lval_ref(lval_nth(y, i));
+      x = x->type == LVAL_PVEC ? pvec_conj(x, e) : lval_add(x, e);
+    }
+    lval_del(y);
+    return x;
+  }
+
+  x = lval_own(x);
+  lval_reserve(x, y->count);
+  //Move the cells over if nothing else holds y, otherwise
+  //share them
+  if(y->rc == 1 && !y->slice){
+    memcpy(x->cell + x->count, y->cell, sizeof(lval*) * y->count);
+    x->count += y->count;
+    y->count = 0;
+  }else{
+    for(int i = 0; i < y->count; i++){
+      x->cell[x->count++] = lval_ref(y->cell[i]);
+    }
+  }
+  lval_del(y);
+  return x;
+}
+
+
+lval* builtin_join(lenv* env,lval* a){
+  for(int i = 0; i < a->count; i++){
+    LASSERT(a, LVAL_TYPE(a->cell[i]) == LVAL_QEXPR ||
+      LVAL_TYPE(a->cell[i]) == LVAL_PVEC, 
+      "Function 'join' passed incorrect type."
+      "Got a %s, Expected %s", 
+    ltype_name(LVAL_TYPE(a->cell[i])), ltype_name(LVAL_QEXPR));
+  }
+
+  //The result has the type of the first argument
+  lval* x = pop(a,0);
+  while(a->count){
+    x = lval_join(x, pop(a,0));
+  }
+
+  lval_del(a);
+  return x;
+}
+
+//Convert a Q-Expression or numeric vector to a vector
+lval* builtin_vec(lenv* env, lval* a){
+  LASSERT_NUM("vec", a, 1);
+  if(LVAL_TYPE(a->cell[0]) == LVAL_NUMS){
+    lval* v = lval_pvec();
+    for(int i = 0; i < a->cell[0]->length; i++){
+      v = pvec_conj(v, lval_num(a->cell[0]->data[i]));
+    }
+    lval_del(a);
+    return v;
+  }
+  LASSERT_SEQ("vec", a, 0);
+  return lval_join(lval_pvec(), take(a, 0));
+}
+
+lval* builtin_len(lenv* env, lval* a){
+  LASSERT_NUM("len", a, 1);
+  if(LVAL_TYPE(a->cell[0]) != LVAL_NUMS){ LASSERT_SEQ("len", a, 0); }
+  lval* x = lval_num(lval_len(a->cell[0]));
+  lval_del(a);
+  return x;
+}
+
+//The element at an index of a Q-Expression or vector
+lval* builtin_nth(lenv* env, lval* a){
+  LASSERT_NUM("nth", a, 2);
+  int nums = LVAL_TYPE(a->cell[0]) == LVAL_NUMS;
+  if(!nums){ LASSERT_SEQ("nth", a, 0); }
+  LASSERT_TYPE("nth", a, 1, LVAL_NUM);
+  long i = LVAL_NUM_VAL(a->cell[1]);
+  int n = lval_len(a->cell[0]);
+  LASSERT(a, i >= 0 && i < n,
+    "Function 'nth' passed index %li. Length is %i", i, n);
+  //Numeric vectors don't hold lvals, so box the number
+  lval* x = nums ? lval_num(a->cell[0]->data[i])
+    : lval_ref(lval_nth(a->cell[0], i));
+  lval_del(a);
+  return x;
+}
+
+//Replace the element at an index, or add one at the end
+lval* builtin_assoc_nth(lenv* env, lval* a){
+  LASSERT_NUM("assoc-nth", a, 3);
+  LASSERT_SEQ("assoc-nth", a, 0);
+  LASSERT_TYPE("assoc-nth", a, 1, LVAL_NUM);
+  long i = LVAL_NUM_VAL(a->cell[1]);
+  int n = lval_len(a->cell[0]);
+  LASSERT(a, i >= 0 && i <= n,
+    "Function 'assoc-nth' passed index %li. Length is %i", i, n);
+
+  lval* v = pop(a, 0);
+  lval* x = lval_ref(a->cell[1]);
+  lval_del(a);
+  if(v->type == LVAL_PVEC){
+    return i == n ? pvec_conj(v, x) : pvec_assoc(v, i, x);
+  }
+  if(i == n){ return lval_add(v, x); }
+  v = lval_own(v);
+  lval_del(v->cell[i]);
+  v->cell[i] = x;
+  return v;
+}
+
+//Add values to the end of a Q-Expression or vector
+lval* builtin_conj(lenv* env, lval* a){
+  LASSERT(a, a->count >= 2,
+    "Function 'conj' passed too few arguments. "
+    "Got %i, Expected at least %i.", a->count, 2);
+  LASSERT_SEQ("conj", a, 0);
+
+  lval* v = pop(a, 0);
+  for(int i = 0; i < a->count; i++){
+    lval* x = lval_ref(a->cell[i]);
+    v = v->type == LVAL_PVEC ? pvec_conj(v, x) : lval_add(v, x);
+  }
+  lval_del(a);
+  return v;
+}
 
-  //Reallocate the memory used
-  v->cell = realloc(v->cell, sizeof(lval*) * v->count);
+//Join Q-Expressions and vectors into a vector
+lval* builtin_concat(lenv* env, lval* a){
+  for(int i = 0; i < a->count; i++){
+    LASSERT_SEQ("concat", a, i);
+  }
 
+  lval* x = LVAL_TYPE(a->cell[0]) == LVAL_PVEC ? pop(a, 0) : lval_pvec();
+  while(a->count){
+    x = lval_join(x, pop(a, 0));
+  }
+  lval_del(a);
   return x;
-
 }
-//Similar to pop but it deletes the list 
-//it has extracted the value from. 
-lval* take(lval* v, int i){
-  lval* x = pop(v, i);
+
+//The elements of a Q-Expression or vector from one index up
+//to another, sharing the original's storage
+lval* builtin_slice(lenv* env, lval* a){
+  LASSERT_NUM("slice", a, 3);
+  LASSERT_SEQ("slice", a, 0);
+  LASSERT_TYPE("slice", a, 1, LVAL_NUM);
+  LASSERT_TYPE("slice", a, 2, LVAL_NUM);
+  long i = LVAL_NUM_VAL(a->cell[1]);
+  long j = LVAL_NUM_VAL(a->cell[2]);
+  int n = lval_len(a->cell[0]);
+  LASSERT(a, 0 <= i && i <= j && j <= n,
+    "Function 'slice' passed range %li to %li. Length is %i", i, j, n);
+
+  lval* v = pop(a, 0);
+  lval_del(a);
+  if(v->type == LVAL_PVEC){ return pvec_slice(v, i, j); }
+  lval* x = lval_slice(v, i, j - i);
   lval_del(v);
   return x;
 }
 
-//Builtin operator function
-lval* builtin_op(lenv* env, lval* a, char* op){
-  //Make sure all arguments are numbers
-  for(int i = 0; i < a->count; i++){
-    if(a->cell[i]->type != LVAL_NUM){
-      lval_del(a);
-      return lval_err("Function '%s' passed incorrect type for argument 1."
-      "Got %s. Expected %s",op, ltype_name(a->cell[i]->type),ltype_name(LVAL_NUM));     
-    }
-  }
-
-  // Pop the first element
-  lval* x = pop(a, 0);
-
-  //If there are no arguments and substraction we 
-  //do unary negation
-  if((strcmp(op,"-") == 0) && a->count == 0){
-    x->num = -x->num;
+//Apply a function to each element of a Q-Expression or
+//vector, giving a sequence of the same type
+lval* builtin_map(lenv* env, lval* a){
+  LASSERT_NUM("map", a, 2);
+  LASSERT_TYPE("map", a, 0, LVAL_FUN);
+  LASSERT_SEQ("map", a, 1);
+  lval* f = a->cell[0];
+  lval* s = a->cell[1];
+  int n = lval_len(s);
+
+  int vec = s->type == LVAL_PVEC;
+  lval* r = vec ? lval_pvec() : lval_qexpr();
+  if(!vec){
+    lval_cells(r, n);
+    r->count = 0;
   }
-
-  //While there are more elements remaining
-  while(a->count > 0){
-    lval* y = pop(a,0);
-    if (strcmp(op,"+")== 0){
-      x->num += y->num;
+  lval* l = NULL;
+  for(int i = 0; i < n; i++){
+    lval* x = lval_nth(s, i);
+    x = lval_call_with(env, f, &x, 1, &l);
+    if(LVAL_TYPE(x) == LVAL_ERR){
+      lval_del(r);
+      r = x;
+      break;
     }
-
-    if (strcmp(op,"-") == 0){
-      x->num -= y->num;
+    if(vec){
+      r = pvec_conj(r, x);
+    }else{
+      r->cell[r->count++] = x;
     }
+  }
+  if(l){ lval_del(l); }
+  lval_del(a);
+  return r;
+}
 
-    if (strcmp(op,"*") == 0){
-      x->num *= y->num;
+//The elements of a Q-Expression or vector that a predicate
+//is true for
+lval* builtin_filter(lenv* env, lval* a){
+  LASSERT_NUM("filter", a, 2);
+  LASSERT_TYPE("filter", a, 0, LVAL_FUN);
+  LASSERT_SEQ("filter", a, 1);
+  lval* f = a->cell[0];
+  lval* s = a->cell[1];
+  int n = lval_len(s);
+
+  int vec = s->type == LVAL_PVEC;
+  lval* r = vec ? lval_pvec() : lval_qexpr();
+  lval* l = NULL;
+  for(int i = 0; i < n; i++){
+    lval* x = lval_nth(s, i);
+    lval* keep = lval_call_with(env, f, &x, 1, &l);
+    if(LVAL_TYPE(keep) != LVAL_NUM){
+      lval_del(r);
+      r = LVAL_TYPE(keep) == LVAL_ERR ? lval_ref(keep) :
+        lval_err("Function 'filter' passed a predicate returning %s. "
+          "Expected %s", ltype_name(LVAL_TYPE(keep)), ltype_name(LVAL_NUM));
+      lval_del(keep);
+      break;
     }
-
-    if (strcmp(op,"%") == 0){
-      x->num %= y->num;
+    if(LVAL_NUM_VAL(keep)){
+      r = vec ? pvec_conj(r, lval_ref(x)) : lval_add(r, lval_ref(x));
     }
+    lval_del(keep);
+  }
+  if(l){ lval_del(l); }
+  lval_del(a);
+  return r;
+}
 
-    if (strcmp(op,"/") == 0){
-      if ( y->num == 0){
-        lval_del(x); lval_del(y);
-        x = lval_err("Division By zero!");
-        break;
-      }
-      x->num /= y->num;
+//Fold the elements of a Q-Expression or vector into an
+//accumulator, from the left calling (f acc x) and from the
+//right calling (f x acc)
+lval* builtin_fold(lenv* env, lval* a, char* func, int right){
+  LASSERT_NUM(func, a, 3);
+  LASSERT_TYPE(func, a, 0, LVAL_FUN);
+  LASSERT_SEQ(func, a, 2);
+  lval* f = a->cell[0];
+  lval* s = a->cell[2];
+  int n = lval_len(s);
+
+  lval* acc = lval_ref(a->cell[1]);
+  lval* l = NULL;
+  for(int i = 0; i < n && LVAL_TYPE(acc) != LVAL_ERR; i++){
+    lval* args[2];
+    if(right){
+      args[0] = lval_nth(s, n - 1 - i);
+      args[1] = acc;
+    }else{
+      args[0] = acc;
+      args[1] = lval_nth(s, i);
     }
-
-    lval_del(y);
+    lval* x = lval_call_with(env, f, args, 2, &l);
+    lval_del(acc);
+    acc = x;
   }
-
-  lval_del(a); return x;
-
+  if(l){ lval_del(l); }
+  lval_del(a);
+  return acc;
 }
 
-char* ltype_name(int t){
-  switch(t){
-    case LVAL_STR:
-      return "String";
-    case LVAL_FUN: 
-      return "Function";
-    case LVAL_NUM:
-      return "Number";
-    case LVAL_ERR:
-      return "Error";
-    case LVAL_SYM:
-      return "Symbol";
-    case LVAL_QEXPR:
-      return "Q-Expression";
-    case LVAL_SEXPR:
-      return "S-Expression";
-    default:
-      return "Unknown";
+lval* builtin_foldl(lenv* env, lval* a){ return builtin_fold(env, a, "foldl", 0); }
+lval* builtin_foldr(lenv* env, lval* a){ return builtin_fold(env, a, "foldr", 1); }
+
+//The elements of a Q-Expression or vector in reverse order
+lval* builtin_reverse(lenv* env, lval* a){
+  LASSERT_NUM("reverse", a, 1);
+  LASSERT_SEQ("reverse", a, 0);
+  lval* s = a->cell[0];
+  int n = lval_len(s);
+  lval* r;
+  if(s->type == LVAL_PVEC){
+    r = lval_pvec();
+    for(int i = n - 1; i >= 0; i--){ r = pvec_conj(r, lval_ref(lval_nth(s, i))); }
+  }else if(s->rc == 1 && !s->slice){
+    //Nothing else holds the list, so swap its cells in place
+    r = lval_ref(s);
+    lval_forget(r);
+    for(int i = 0; i < n / 2; i++){
+      lval* x = r->cell[i];
+      r->cell[i] = r->cell[n - 1 - i];
+      r->cell[n - 1 - i] = x;
+    }
+  }else{
+    r = lval_qexpr();
+    lval_cells(r, n);
+    for(int i = 0; i < n; i++){ r->cell[i] = lval_ref(s->cell[n - 1 - i]); }
   }
+  lval_del(a);
+  return r;
 }
 
+//A Q-Expression of the numbers from one up to but not
+//including another
+lval* builtin_range(lenv* env, lval* a){
+  LASSERT_NUM("range", a, 2);
+  LASSERT_TYPE("range", a, 0, LVAL_NUM);
+  LASSERT_TYPE("range", a, 1, LVAL_NUM);
+  long from = LVAL_NUM_VAL(a->cell[0]);
+  long to = LVAL_NUM_VAL(a->cell[1]);
+  //The span is worked out unsigned, as it may not fit a long
+  unsigned long n = from < to ? (unsigned long)to - (unsigned long)from : 0;
+  LASSERT(a, n <= INT_MAX,
+    "Function 'range' passed range %li to %li. Too long", from, to);
+  lval** cells = n ? malloc(sizeof(lval*) * n) : NULL;
+  LASSERT(a, !n || cells,
+    "Function 'range' passed range %li to %li. Out of memory", from, to);
+  lval_del(a);
 
-lval* builtin_lambda(lenv* e, lval* a){
-  //Check 2 arguments, each of which is
-  //a q-expression
-  LASSERT_NUM("\\", a, 2);
-  LASSERT_TYPE("\\", a, 0, LVAL_QEXPR);
-  LASSERT_TYPE("\\", a, 1, LVAL_QEXPR);
+  lval* r = lval_qexpr();
+  r->cell = cells;
+  r->count = n;
+  r->capacity = n;
+  for(int i = 0; i < r->count; i++){ r->cell[i] = lval_num(from + i); }
+  return r;
+}
 
-  //Check first Q-expression contains symbols only
-  for(int i = 0; i < a->cell[0]->count; i++){
-    LASSERT(a, (a->cell[0]->cell[i]->type == LVAL_SYM),
-      "Can't define non-symbol. Got %s, Expected %s",
-      ltype_name(a->cell[0]->cell[i]->type),ltype_name(LVAL_SYM));
+//Numeric vector kernels. Elementwise ones write x op y to r,
+//which may be x or y. Comparisons give 1 or 0
+typedef void (*lvk)(long* r, long* x, long* y, int n);
+//Reduce x to one number
+typedef long (*lvr)(long* x, int n);
+//Combine x and y into one number
+typedef long (*lvd)(long* x, long* y, int n);
+
+//Overflow wraps around, the same as in the SIMD kernels
+
+void vk_add(long* r, long* x, long* y, int n){
+  for(int i = 0; i < n; i++){ r[i] = (unsigned long)x[i] + (unsigned long)y[i]; }
+}
+void vk_sub(long* r, long* x, long* y, int n){
+  for(int i = 0; i < n; i++){ r[i] = (unsigned long)x[i] - (unsigned long)y[i]; }
+}
+void vk_mul(long* r, long* x, long* y, int n){
+  for(int i = 0; i < n; i++){ r[i] = (unsigned long)x[i] * (unsigned long)y[i]; }
+}
+//Callers make sure y has no zeros. The SIMD kernels use these
+//too. Dividing by -1 is done as a negation so the smallest
+//long wraps rather than trapping
+void vk_div(long* r, long* x, long* y, int n){
+  for(int i = 0; i < n; i++){
+    r[i] = y[i] == -1 ? (long)-(unsigned long)x[i] : x[i] / y[i];
   }
+}
+void vk_mod(long* r, long* x, long* y, int n){
+  for(int i = 0; i < n; i++){ r[i] = y[i] == -1 ? 0 : x[i] % y[i]; }
+}
+void vk_lt(long* r, long* x, long* y, int n){
+  for(int i = 0; i < n; i++){ r[i] = x[i] < y[i]; }
+}
+void vk_gt(long* r, long* x, long* y, int n){
+  for(int i = 0; i < n; i++){ r[i] = x[i] > y[i]; }
+}
+void vk_le(long* r, long* x, long* y, int n){
+  for(int i = 0; i < n; i++){ r[i] = x[i] <= y[i]; }
+}
+void vk_ge(long* r, long* x, long* y, int n){
+  for(int i = 0; i < n; i++){ r[i] = x[i] >= y[i]; }
+}
+void vk_eq(long* r, long* x, long* y, int n){
+  for(int i = 0; i < n; i++){ r[i] = x[i] == y[i]; }
+}
+void vk_ne(long* r, long* x, long* y, int n){
+  for(int i = 0; i < n; i++){ r[i] = x[i] != y[i]; }
+}
 
-  //pop the first 2 arguments and create an lval_lambda
-  lval* formals = pop(a,0);
-  lval* body = pop(a, 0);
-  lval_del(a);
-  return lval_lambda(formals, body);
+long vk_sum(long* x, int n){
+  unsigned long s = 0;
+  for(int i = 0; i < n; i++){ s += x[i]; }
+  return s;
+}
+//min and max are never passed an empty vector
+long vk_min(long* x, int n){
+  long m = x[0];
+  for(int i = 1; i < n; i++){ if(x[i] < m){ m = x[i]; } }
+  return m;
+}
+long vk_max(long* x, int n){
+  long m = x[0];
+  for(int i = 1; i < n; i++){ if(x[i] > m){ m = x[i]; } }
+  return m;
+}
+long vk_dot(long* x, long* y, int n){
+  unsigned long s = 0;
+  for(int i = 0; i < n; i++){ s += (unsigned long)x[i] * (unsigned long)y[i]; }
+  return s;
 }
 
-lval* builtin_head(lenv* env,lval* a){
-  //Error checking
-  LASSERT(a, a->count == 1, 
-    "Too many arguments passed to function 'head'. "
-    "Got %i, Expected %i.", a->count,1);
-  LASSERT(a, a->cell[0]->type == LVAL_QEXPR,
-  "Function head passed incorrect type. "
-  "Got a %s, Expected %s", 
-    ltype_name(a->cell[0]->type), ltype_name(LVAL_QEXPR) );
+#ifdef LISPTER_SIMD
+//Neither SSE nor AVX2 can divide integers or multiply 64 bit
+//ones, so division stays scalar and multiplication is built
+//from 32 bit products: lo*lo + ((hi*lo + lo*hi) << 32)
+#define AVX2 __attribute__((target("avx2")))
+#define SSE4 __attribute__((target("sse4.2")))
 
-  LASSERT(a, a->cell[0]->count !=0, 
-    "Function head passed {}!");
-  //Otherwise take first argument
-  lval* v = take(a, 0);
-  //Delete all elements that are not head and return
-  while(v->count > 1) { lval_del(pop(v,1));}
+AVX2 static inline __m256i avx2_add(__m256i a, __m256i b){
+  return _mm256_add_epi64(a, b);
+}
+AVX2 static inline __m256i avx2_sub(__m256i a, __m256i b){
+  return _mm256_sub_epi64(a, b);
+}
+AVX2 static inline __m256i avx2_mul(__m256i a, __m256i b){
+  __m256i hi = _mm256_add_epi64(
+    _mm256_mul_epu32(_mm256_srli_epi64(a, 32), b),
+    _mm256_mul_epu32(a, _mm256_srli_epi64(b, 32)));
+  return _mm256_add_epi64(_mm256_mul_epu32(a, b), _mm256_slli_epi64(hi, 32));
+}
+//Comparisons give all ones for true, so keep the low bit
+AVX2 static inline __m256i avx2_lt(__m256i a, __m256i b){
+  return _mm256_and_si256(_mm256_cmpgt_epi64(b, a), _mm256_set1_epi64x(1));
+}
+AVX2 static inline __m256i avx2_gt(__m256i a, __m256i b){
+  return _mm256_and_si256(_mm256_cmpgt_epi64(a, b), _mm256_set1_epi64x(1));
+}
+AVX2 static inline __m256i avx2_le(__m256i a, __m256i b){
+  return _mm256_andnot_si256(_mm256_cmpgt_epi64(a, b), _mm256_set1_epi64x(1));
+}
+AVX2 static inline __m256i avx2_ge(__m256i a, __m256i b){
+  return _mm256_andnot_si256(_mm256_cmpgt_epi64(b, a), _mm256_set1_epi64x(1));
+}
+AVX2 static inline __m256i avx2_eq(__m256i a, __m256i b){
+  return _mm256_and_si256(_mm256_cmpeq_epi64(a, b), _mm256_set1_epi64x(1));
+}
+AVX2 static inline __m256i avx2_ne(__m256i a, __m256i b){
+  return _mm256_andnot_si256(_mm256_cmpeq_epi64(a, b), _mm256_set1_epi64x(1));
+}
+AVX2 static inline __m256i avx2_min(__m256i a, __m256i b){
+  return _mm256_blendv_epi8(a, b, _mm256_cmpgt_epi64(a, b));
+}
+AVX2 static inline __m256i avx2_max(__m256i a, __m256i b){
+  return _mm256_blendv_epi8(b, a, _mm256_cmpgt_epi64(a, b));
+}
 
-  return v;
+SSE4 static inline __m128i sse_add(__m128i a, __m128i b){
+  return _mm_add_epi64(a, b);
+}
+SSE4 static inline __m128i sse_sub(__m128i a, __m128i b){
+  return _mm_sub_epi64(a, b);
+}
+SSE4 static inline __m128i sse_mul(__m128i a, __m128i b){
+  __m128i hi = _mm_add_epi64(
+    _mm_mul_epu32(_mm_srli_epi64(a, 32), b),
+    _mm_mul_epu32(a, _mm_srli_epi64(b, 32)));
+  return _mm_add_epi64(_mm_mul_epu32(a, b), _mm_slli_epi64(hi, 32));
+}
+SSE4 static inline __m128i sse_lt(__m128i a, __m128i b){
+  return _mm_and_si128(_mm_cmpgt_epi64(b, a), _mm_set1_epi64x(1));
+}
+SSE4 static inline __m128i sse_gt(__m128i a, __m128i b){
+  return _mm_and_si128(_mm_cmpgt_epi64(a, b), _mm_set1_epi64x(1));
+}
+SSE4 static inline __m128i sse_le(__m128i a, __m128i b){
+  return _mm_andnot_si128(_mm_cmpgt_epi64(a, b), _mm_set1_epi64x(1));
+}
+SSE4 static inline __m128i sse_ge(__m128i a, __m128i b){
+  return _mm_andnot_si128(_mm_cmpgt_epi64(b, a), _mm_set1_epi64x(1));
+}
+SSE4 static inline __m128i sse_eq(__m128i a, __m128i b){
+  return _mm_and_si128(_mm_cmpeq_epi64(a, b), _mm_set1_epi64x(1));
+}
+SSE4 static inline __m128i sse_ne(__m128i a, __m128i b){
+  return _mm_andnot_si128(_mm_cmpeq_epi64(a, b), _mm_set1_epi64x(1));
+}
+SSE4 static inline __m128i sse_min(__m128i a, __m128i b){
+  return _mm_blendv_epi8(a, b, _mm_cmpgt_epi64(a, b));
+}
+SSE4 static inline __m128i sse_max(__m128i a, __m128i b){
+  return _mm_blendv_epi8(b, a, _mm_cmpgt_epi64(a, b));
 }
 
-lval* builtin_tail(lenv* env,lval* a){
-  //Check for errors
-  LASSERT(a, a->count == 1, 
-    "'Tail' passed too many args."
-    "Got %i, Expected %i.", a->count,1);
+//Define the AVX2 and SSE versions of an elementwise kernel.
+//They do 4 or 2 numbers at a time and leave what's left over
+//to the scalar one
+#define VK_SIMD(name)\
+  AVX2 void vk_##name##_avx2(long* r, long* x, long* y, int n){\
+    int i = 0;\
+    for(; i + 4 <= n; i += 4){\
+      __m256i a = _mm256_loadu_si256((__m256i*)(x + i));\
+      __m256i b = _mm256_loadu_si256((__m256i*)(y + i));\
+      _mm256_storeu_si256((__m256i*)(r + i), avx2_##name(a, b));\
+    }\
+    vk_##name(r + i, x + i, y + i, n - i);\
+  }\
+  SSE4 void vk_##name##_sse(long* r, long* x, long* y, int n){\
+    int i = 0;\
+    for(; i + 2 <= n; i += 2){\
+      __m128i a = _mm_loadu_si128((__m128i*)(x + i));\
+      __m128i b = _mm_loadu_si128((__m128i*)(y + i));\
+      _mm_storeu_si128((__m128i*)(r + i), sse_##name(a, b));\
+    }\
+    vk_##name(r + i, x + i, y + i, n - i);\
+  }
 
-  LASSERT(a, a->cell[0]->type == LVAL_QEXPR,
-    "'Tail' passed the wrong types."
-    "Got a %s, Expected %s", 
-    ltype_name(a->cell[0]->type), ltype_name(LVAL_QEXPR));
+VK_SIMD(add)
+VK_SIMD(sub)
+VK_SIMD(mul)
+VK_SIMD(lt)
+VK_SIMD(gt)
+VK_SIMD(le)
+VK_SIMD(ge)
+VK_SIMD(eq)
+VK_SIMD(ne)
+
+//Define the AVX2 and SSE versions of a reduction, which keep
+//a running result per lane and combine the lanes at the end.
+//Only called with at least one number
+#define VK_SIMD_FOLD(name)\
+  AVX2 long vk_##name##_avx2(long* x, int n){\
+    if(n < 4){ return vk_##name(x, n); }\
+    __m256i s = _mm256_loadu_si256((__m256i*)x);\
+    int i = 4;\
+    for(; i + 4 <= n; i += 4){\
+      s = avx2_##name(s, _mm256_loadu_si256((__m256i*)(x + i)));\
+    }\
+    long l[8];\
+    _mm256_storeu_si256((__m256i*)l, s);\
+    for(int j = 0; j < n - i; j++){ l[4 + j] = x[i + j]; }\
+    return vk_##name(l, 4 + n - i);\
+  }\
+  SSE4 long vk_##name##_sse(long* x, int n){\
+    if(n < 2){ return vk_##name(x, n); }\
+    __m128i s = _mm_loadu_si128((__m128i*)x);\
+    int i = 2;\
+    for(; i + 2 <= n; i += 2){\
+      s = sse_##name(s, _mm_loadu_si128((__m128i*)(x + i)));\
+    }\
+    long l[3];\
+    _mm_storeu_si128((__m128i*)l, s);\
+    l[2] = x[n - 1];\
+    return vk_##name(l, 2 + n - i);\
+  }
 
-  LASSERT(a, a->cell[0]->count != 0,
-    "Function tail passed {}!");
-  //Take first argument
-  lval* v = take(a,0);
-  //Delete first element and return 
-  lval_del(pop(v,0));
+VK_SIMD_FOLD(min)
+VK_SIMD_FOLD(max)
 
-  return v;
+//Sums start from zero, so they don't need the first lanes
+//filled in
+AVX2 long vk_sum_avx2(long* x, int n){
+  __m256i s = _mm256_setzero_si256();
+  int i = 0;
+  for(; i + 4 <= n; i += 4){
+    s = _mm256_add_epi64(s, _mm256_loadu_si256((__m256i*)(x + i)));
+  }
+  long l[4];
+  _mm256_storeu_si256((__m256i*)l, s);
+  return (unsigned long)l[0] + l[1] + l[2] + l[3] + vk_sum(x + i, n - i);
 }
-
-lval* builtin_list(lenv* env,lval* a){
-  a->type = LVAL_QEXPR;
-  return a;
+SSE4 long vk_sum_sse(long* x, int n){
+  __m128i s = _mm_setzero_si128();
+  int i = 0;
+  for(; i + 2 <= n; i += 2){
+    s = _mm_add_epi64(s, _mm_loadu_si128((__m128i*)(x + i)));
+  }
+  long l[2];
+  _mm_storeu_si128((__m128i*)l, s);
+  return (unsigned long)l[0] + l[1] + vk_sum(x + i, n - i);
+}
+AVX2 long vk_dot_avx2(long* x, long* y, int n){
+  __m256i s = _mm256_setzero_si256();
+  int i = 0;
+  for(; i + 4 <= n; i += 4){
+    s = _mm256_add_epi64(s, avx2_mul(_mm256_loadu_si256((__m256i*)(x + i)),
+      _mm256_loadu_si256((__m256i*)(y + i))));
+  }
+  long l[4];
+  _mm256_storeu_si256((__m256i*)l, s);
+  return (unsigned long)l[0] + l[1] + l[2] + l[3] + vk_dot(x + i, y + i, n - i);
 }
+SSE4 long vk_dot_sse(long* x, long* y, int n){
+  __m128i s = _mm_setzero_si128();
+  int i = 0;
+  for(; i + 2 <= n; i += 2){
+    s = _mm_add_epi64(s, sse_mul(_mm_loadu_si128((__m128i*)(x + i)),
+      _mm_loadu_si128((__m128i*)(y + i))));
+  }
+  long l[2];
+  _mm_storeu_si128((__m128i*)l, s);
+  return (unsigned long)l[0] + l[1] + vk_dot(x + i, y + i, n - i);
+}
+#endif
 
-lval* builtin_eval(lenv* env,lval* a){
-  LASSERT(a, a->count == 1, 
-    "Function 'eval' passed too many arguments!"
-    "Got %i, Expected %i.", a->count,1);
-  LASSERT(a, a->cell[0]->type == LVAL_QEXPR, 
-    "Function 'eval' passed incorrect type!"
-    "Got a %s, Expected %s", 
-    ltype_name(a->cell[0]->type), ltype_name(LVAL_QEXPR));
+//A set of kernels for one instruction set
+typedef struct{
+  char* name;
+  lvk add, sub, mul, div, mod, lt, gt, le, ge, eq, ne;
+  lvr sum, min, max;
+  lvd dot;
+} lkernels;
+
+lkernels vk_scalar = {"scalar", vk_add, vk_sub, vk_mul, vk_div, vk_mod,
+  vk_lt, vk_gt, vk_le, vk_ge, vk_eq, vk_ne, vk_sum, vk_min, vk_max, vk_dot};
+#ifdef LISPTER_SIMD
+lkernels vk_sse = {"sse4.2", vk_add_sse, vk_sub_sse, vk_mul_sse, vk_div,
+  vk_mod, vk_lt_sse, vk_gt_sse, vk_le_sse, vk_ge_sse, vk_eq_sse, vk_ne_sse,
+  vk_sum_sse, vk_min_sse, vk_max_sse, vk_dot_sse};
+lkernels vk_avx2 = {"avx2", vk_add_avx2, vk_sub_avx2, vk_mul_avx2, vk_div,
+  vk_mod, vk_lt_avx2, vk_gt_avx2, vk_le_avx2, vk_ge_avx2, vk_eq_avx2,
+  vk_ne_avx2, vk_sum_avx2, vk_min_avx2, vk_max_avx2, vk_dot_avx2};
+#endif
 
-  lval* x = take(a, 0);
-  x->type = LVAL_SEXPR;
-  return eval(env, x);
+//The best kernels this CPU can run, picked on first use
+lkernels* vk_best(void){
+  static lkernels* best = NULL;
+  if(best){ return best; }
+  best = &vk_scalar;
+#ifdef LISPTER_SIMD
+  __builtin_cpu_init();
+  if(__builtin_cpu_supports("avx2")){
+    best = &vk_avx2;
+  }else if(__builtin_cpu_supports("sse4.2")){
+    best = &vk_sse;
+  }
+#endif
+  return best;
 }
 
-lval* lval_join(lval* x, lval* y){
-  //For each cell in y add it to x
-  while(y->count){
-    x = lval_add(x, pop(y,0));
+//Pack the numbers of a Q-Expression or vector into a
+//numeric vector
+lval* builtin_nums(lenv* env, lval* a){
+  LASSERT_NUM("nums", a, 1);
+  if(LVAL_TYPE(a->cell[0]) == LVAL_NUMS){ return take(a, 0); }
+  LASSERT_SEQ("nums", a, 0);
+  lval* s = a->cell[0];
+  int n = lval_len(s);
+  for(int i = 0; i < n; i++){
+    LASSERT(a, LVAL_TYPE(lval_nth(s, i)) == LVAL_NUM,
+      "Function 'nums' passed a %s at index %i. Expected %s",
+      ltype_name(LVAL_TYPE(lval_nth(s, i))), i, ltype_name(LVAL_NUM));
   }
-  lval_del(y);
-  return x;
+  lval* v = lval_nums(n);
+  for(int i = 0; i < n; i++){ v->data[i] = LVAL_NUM_VAL(lval_nth(s, i)); }
+  lval_del(a);
+  return v;
 }
 
+//The numbers of a numeric vector, or a new array of n copies
+//of a number
+long* nums_spread(lval* v, int n){
+  if(LVAL_TYPE(v) == LVAL_NUMS){ return v->data; }
+  long* x = malloc(sizeof(long) * (n > 0 ? n : 1));
+  for(int i = 0; i < n; i++){ x[i] = LVAL_NUM_VAL(v); }
+  return x;
+}
 
-lval* builtin_join(lenv* env,lval* a){
-  for(int i = 0; i < a->count; i++){
-    LASSERT(a, a->cell[i]->type == LVAL_QEXPR, 
-      "Function 'join' passed incorrect type."
-      "Got a %s, Expected %s", 
-    ltype_name(a->cell[i]->type), ltype_name(LVAL_QEXPR));
+//Elementwise operator on two numeric vectors of the same
+//length, or one and a number to use for every element.
+//k does the work, and division checks for zeros first
+lval* builtin_nums_op(lenv* env, lval* a, char* op, lvk k){
+  LASSERT_NUM(op, a, 2);
+  int n = -1;
+  for(int i = 0; i < 2; i++){
+    int t = LVAL_TYPE(a->cell[i]);
+    LASSERT(a, t == LVAL_NUMS || t == LVAL_NUM,
+      "Function '%s' passed incorrect type for argument %i. "
+      "Got %s, Expected %s or %s", op, i, ltype_name(t),
+      ltype_name(LVAL_NUMS), ltype_name(LVAL_NUM));
+    if(t != LVAL_NUMS){ continue; }
+    LASSERT(a, n < 0 || n == a->cell[i]->length,
+      "Function '%s' passed vectors of length %i and %i",
+      op, n, a->cell[i]->length);
+    n = a->cell[i]->length;
   }
+  LASSERT(a, n >= 0, "Function '%s' passed no %s", op, ltype_name(LVAL_NUMS));
 
-  lval* x = pop(a,0);
-  while(a->count){
-    x = lval_join(x, pop(a,0));
+  long* x = nums_spread(a->cell[0], n);
+  long* y = nums_spread(a->cell[1], n);
+  int zero = 0;
+  if(k == vk_div || k == vk_mod){
+    for(int i = 0; i < n; i++){ zero |= y[i] == 0; }
+  }
+  lval* r = NULL;
+  if(!zero){
+    //Write over an argument nothing else holds
+    for(int i = 0; i < 2 && !r; i++){
+      lval* v = a->cell[i];
+      if(LVAL_TYPE(v) == LVAL_NUMS && v->rc == 1){ r = lval_ref(v); }
+    }
+    if(!r){ r = lval_nums(n); }
+    k(r->data, x, y, n);
   }
+  if(LVAL_TYPE(a->cell[0]) != LVAL_NUMS){ free(x); }
+  if(LVAL_TYPE(a->cell[1]) != LVAL_NUMS){ free(y); }
+  lval_del(a);
+  return zero ? lval_err_common(LERR_DIV_ZERO) : r;
+}
 
+//Reduce a numeric vector to a number. min and max need at
+//least one element
+lval* builtin_nums_fold(lenv* env, lval* a, char* func, lvr k){
+  LASSERT_NUM(func, a, 1);
+  LASSERT_TYPE(func, a, 0, LVAL_NUMS);
+  LASSERT(a, a->cell[0]->length != 0 || !strcmp(func, "sum"),
+    "Function '%s' passed an empty %s", func, ltype_name(LVAL_NUMS));
+  long x = k(a->cell[0]->data, a->cell[0]->length);
   lval_del(a);
-  return x;
+  return lval_num(x);
+}
+
+lval* builtin_dot(lenv* env, lval* a){
+  LASSERT_NUM("dot", a, 2);
+  LASSERT_TYPE("dot", a, 0, LVAL_NUMS);
+  LASSERT_TYPE("dot", a, 1, LVAL_NUMS);
+  LASSERT(a, a->cell[0]->length == a->cell[1]->length,
+    "Function 'dot' passed vectors of length %i and %i",
+    a->cell[0]->length, a->cell[1]->length);
+  long x = vk_best()->dot(a->cell[0]->data, a->cell[1]->data,
+    a->cell[0]->length);
+  lval_del(a);
+  return lval_num(x);
+}
+
+lval* builtin_vadd(lenv* e, lval* a){ return builtin_nums_op(e, a, "v+", vk_best()->add); }
+lval* builtin_vsub(lenv* e, lval* a){ return builtin_nums_op(e, a, "v-", vk_best()->sub); }
+lval* builtin_vmul(lenv* e, lval* a){ return builtin_nums_op(e, a, "v*", vk_best()->mul); }
+lval* builtin_vdiv(lenv* e, lval* a){ return builtin_nums_op(e, a, "v/", vk_best()->div); }
+lval* builtin_vmod(lenv* e, lval* a){ return builtin_nums_op(e, a, "v%", vk_best()->mod); }
+lval* builtin_vlt(lenv* e, lval* a){ return builtin_nums_op(e, a, "v<", vk_best()->lt); }
+lval* builtin_vgt(lenv* e, lval* a){ return builtin_nums_op(e, a, "v>", vk_best()->gt); }
+lval* builtin_vle(lenv* e, lval* a){ return builtin_nums_op(e, a, "v<=", vk_best()->le); }
+lval* builtin_vge(lenv* e, lval* a){ return builtin_nums_op(e, a, "v>=", vk_best()->ge); }
+lval* builtin_veq(lenv* e, lval* a){ return builtin_nums_op(e, a, "v==", vk_best()->eq); }
+lval* builtin_vne(lenv* e, lval* a){ return builtin_nums_op(e, a, "v!=", vk_best()->ne); }
+lval* builtin_sum(lenv* e, lval* a){ return builtin_nums_fold(e, a, "sum", vk_best()->sum); }
+lval* builtin_min(lenv* e, lval* a){ return builtin_nums_fold(e, a, "min", vk_best()->min); }
+lval* builtin_max(lenv* e, lval* a){ return builtin_nums_fold(e, a, "max", vk_best()->max); }
+
+lval* fast_add(lval** v, int n){ return fast_op(v, n, op_add); }
+lval* fast_sub(lval** v, int n){ return fast_op(v, n, op_sub); }
+lval* fast_mul(lval** v, int n){ return fast_op(v, n, op_mul); }
+lval* fast_div(lval** v, int n){ return fast_op(v, n, op_div); }
+lval* fast_mod(lval** v, int n){ return fast_op(v, n, op_mod); }
+
+int ord_gt(long x, long y){ return x > y; }
+int ord_lt(long x, long y){ return x < y; }
+int ord_le(long x, long y){ return x <= y; }
+int ord_ge(long x, long y){ return x >= y; }
+
+//Fast ordering of two fixnums
+lval* fast_ord(lval** v, int n, lord k){
+  if(n != 2 || !LVAL_IS_FIX(v[0]) || !LVAL_IS_FIX(v[1])){ return NULL; }
+  return LVAL_FIX(k(LVAL_FIX_VAL(v[0]), LVAL_FIX_VAL(v[1])));
+}
+lval* fast_gt(lval** v, int n){ return fast_ord(v, n, ord_gt); }
+lval* fast_lt(lval** v, int n){ return fast_ord(v, n, ord_lt); }
+lval* fast_le(lval** v, int n){ return fast_ord(v, n, ord_le); }
+lval* fast_ge(lval** v, int n){ return fast_ord(v, n, ord_ge); }
+
+//Equality never allocates, so it takes any two values that
+//aren't errors
+lval* fast_eq(lval** v, int n){
+  if(n != 2 || LVAL_TYPE(v[0]) == LVAL_ERR || LVAL_TYPE(v[1]) == LVAL_ERR){
+    return NULL;
+  }
+  return LVAL_FIX(lval_eq(v[0], v[1]) != 0);
+}
+lval* fast_neq(lval** v, int n){
+  if(n != 2 || LVAL_TYPE(v[0]) == LVAL_ERR || LVAL_TYPE(v[1]) == LVAL_ERR){
+    return NULL;
+  }
+  return LVAL_FIX(lval_eq(v[0], v[1]) == 0);
 }
 
 lval* builtin_mod(lenv* env, lval* a){
-  return builtin_op(env, a, "%");
+  return builtin_op(env, a, "%", op_mod);
 }
 
 lval* builtin_add(lenv* env, lval* a){
-  return builtin_op(env, a, "+");
+  return builtin_op(env, a, "+", op_add);
 }
 
 lval* builtin_sub(lenv* env, lval* a){
-  return builtin_op(env, a, "-");
+  return builtin_op(env, a, "-", op_sub);
 }
 
 lval* builtin_mul(lenv* env, lval* a){
-  return builtin_op(env, a, "*");
+  return builtin_op(env, a, "*", op_mul);
 }
 
 lval* builtin_div(lenv* env, lval* a){
-  return builtin_op(env, a, "/");
+  return builtin_op(env, a, "/", op_div);
 }
 
 lval* builtin_gt(lenv* env, lval* a){
-  return builtin_ord(env, a, ">");
+  return builtin_ord(env, a, ">", ord_gt);
 }
 lval* builtin_lt(lenv* env, lval* a){
-  return builtin_ord(env, a, "<");
+  return builtin_ord(env, a, "<", ord_lt);
 }
 lval* builtin_le(lenv* env, lval* a){
-  return builtin_ord(env, a, "<=");
+  return builtin_ord(env, a, "<=", ord_le);
 }
 lval* builtin_ge(lenv* env, lval* a){
-  return builtin_ord(env, a, ">=");
+  return builtin_ord(env, a, ">=", ord_ge);
 }
 lval* builtin_eq(lenv* env, lval* a){
-  return builtin_cmp(env, a , "==");
+  return builtin_cmp(env, a, "==", 1);
 }
 lval* builtin_neq(lenv* env, lval* a){
-  return builtin_cmp(env, a , "!=");
+  return builtin_cmp(env, a, "!=", 0);
+}
+
+//Builtins without side effects, under the names they're
+//added with. Calls to them on constants are folded into
+//their values by the compiled code (see OP_FOLD)
+struct{
+  char* name;
+  lbuiltin builtin;
+} lpure[] = {
+  {"+", builtin_add}, {"-", builtin_sub}, {"*", builtin_mul},
+  {"/", builtin_div}, {"%", builtin_mod},
+  {">", builtin_gt}, {"<", builtin_lt}, {">=", builtin_ge},
+  {"<=", builtin_le}, {"==", builtin_eq}, {"!=", builtin_neq},
+  {"list", builtin_list}, {"head", builtin_head},
+  {"tail", builtin_tail}, {"join", builtin_join},
+};
+
+#define LPURE_COUNT (int)(sizeof(lpure) / sizeof(lpure[0]))
+
+//Check whether f is one of those builtins
+int lval_pure(lval* f){
+  if(LVAL_TYPE(f) != LVAL_FUN || !f->builtin){ return 0; }
+  for(int i = 0; i < LPURE_COUNT; i++){
+    if(f->builtin == lpure[i].builtin){ return 1; }
+  }
+  return 0;
 }
 lval* builtin_put(lenv* env, lval* a){
-  return builtin_var(env, a, "=");
+  return builtin_var(env, a, "=", lenv_put);
 }
 
 lval* builtin_def(lenv* env, lval* a){
-  return builtin_var(env, a, "def");
+  return builtin_var(env, a, "def", lenv_def);
 }
 
 
+//Call the builtin registered under the name func
 lval* builtin(lenv* env, lval* a, char* func){
-  if (strcmp("list", func) == 0) {
-    return builtin_list(env,a);
-  }
-  if (strcmp("head", func) == 0) {
-    return builtin_head(env,a);
-  }
-  if (strcmp("tail", func) == 0) {
-    return builtin_tail(env,a);
-  }
-  if (strcmp("join", func) == 0) {
-    return builtin_join(env,a);
+  while(env->parent){ env = env->parent; }
+  lval* k = lval_sym(func);
+  lval* f = lenv_get(env, k);
+  lval_del(k);
+  if(LVAL_TYPE(f) != LVAL_FUN || !f->builtin){
+    lval_del(f); lval_del(a);
+    return lval_err("Unknown Function '%s'",func);
   }
-  if (strcmp("eval", func) == 0) {
-    return builtin_eval(env,a);
-  }
-  if(strstr("+-/*", func)){ 
-    return builtin_op(env, a, func);
-  }
-
-  lval_del(a);
-  return lval_err("Unknown Function '%s'",func);
-
+  return lval_call(env, f, a);
 }
 
-lval* builtin_ord(lenv* env, lval* a, char* op){
+lval* builtin_ord(lenv* env, lval* a, char* op, lord k){
   LASSERT_NUM(op, a, 2);
   LASSERT_TYPE(op, a, 0, LVAL_NUM);
   LASSERT_TYPE(op, a, 1, LVAL_NUM);
  
-  int result;
-
-  if(strcmp(op, ">")== 0){
-    result = (a->cell[0]->num > a->cell[1]->num);
-  }
-  else if(strcmp(op, "<")== 0){
-    result = (a->cell[0]->num < a->cell[1]->num);
-  }
-  else if(strcmp(op, "<=")== 0){
-    result = (a->cell[0]->num <= a->cell[1]->num);
-  }
-  else if(strcmp(op, ">=")== 0){
-    result = (a->cell[0]->num >= a->cell[1]->num);
-  }
+  int result = k(LVAL_NUM_VAL(a->cell[0]), LVAL_NUM_VAL(a->cell[1]));
   lval_del(a);
   return lval_num(result);
 }
 
-lval* builtin_cmp(lenv* env, lval* a, char* op){
+//eq is 1 for == and 0 for !=
+lval* builtin_cmp(lenv* env, lval* a, char* op, int eq){
   LASSERT_NUM(op, a, 2);
-  int result;
-  if(strcmp(op, "==") == 0){
-    result = lval_eq(a->cell[0], a->cell[1]);
-  }
-  else if(strcmp(op, "!=") == 0){
-    result = (!lval_eq(a->cell[0], a->cell[1]));
-  }
+  int result = (lval_eq(a->cell[0], a->cell[1]) != 0) == eq;
   lval_del(a);
 
   return lval_num(result);
 }
 
-lval* builtin_var(lenv* e, lval* a, char* func){
+//bind is lenv_def for 'def' and lenv_put for '='
+lval* builtin_var(lenv* e, lval* a, char* func, lbind bind){
   LASSERT_TYPE(func, a, 0, LVAL_QEXPR);
 
   lval* syms = a->cell[0];
   for(int i = 0; i < syms->count; i++){
-    LASSERT(a, (syms->cell[i]->type == LVAL_SYM), 
+    LASSERT(a, (LVAL_TYPE(syms->cell[i]) == LVAL_SYM), 
     "Function '%s' cannot define non-symbol. "
     "Got %s, Expected %s.", func,
-    ltype_name(syms->cell[i]->type),
+    ltype_name(LVAL_TYPE(syms->cell[i])),
     ltype_name(LVAL_SYM));
   }
 
@@ -1005,13 +4004,7 @@ lval* builtin_var(lenv* e, lval* a, char* func){
     "Got %i, Expected %i", func, syms->count, a->count-1);
 
   for (int i = 0; i<syms->count; i++){
-    //If 'def' define globally. If 'put' define locally
-    if(strcmp(func, "def") == 0){
-      lenv_def(e, syms->cell[i], a->cell[i+1]);
-    }
-    if(strcmp(func, "=") == 0){
-      lenv_put(e, syms->cell[i], a->cell[i+1]);
-    }
+    bind(e, syms->cell[i], a->cell[i+1]);
   }
   lval_del(a);
   return lval_sexpr();
@@ -1024,19 +4017,10 @@ lval* builtin_if(lenv* env, lval* a){
   LASSERT_TYPE("if", a,1,LVAL_QEXPR);
   LASSERT_TYPE("if", a,2,LVAL_QEXPR);
 
-  //Make both expressions so they can be evaluated
-  lval* x;
-  a->cell[1]->type = LVAL_SEXPR;
-  a->cell[2]->type = LVAL_SEXPR;
-
-  if(a->cell[0]->num){
-    //if condition is true eval first expression
-    x = eval(env, pop(a,1));
-  }else{
-    //otherwise evaluate the second expression
-    x = eval(env, pop(a, 2));
-  }
-//Delete a
+  //if condition is true run the first expression, otherwise
+  //the second. The branch is run as it is, not taken apart
+  lval* x = lval_run(env, a->cell[LVAL_NUM_VAL(a->cell[0]) ? 1 : 2]);
+  //Delete a
   lval_del(a);
   return x;
 }
@@ -1055,6 +4039,27 @@ lval* builtin_print(lenv* env, lval* a){
   return lval_sexpr();
 }
 
+//Print allocator counters for each size class. A lone
+//function in an S-expression isn't called, so any arguments
+//are accepted and ignored, as in (memstats ())
+lval* builtin_memstats(lenv* env, lval* a){
+  printf("%-6s %6s %10s %10s %10s %6s\n",
+    "class", "size", "live", "slots", "slabs", "used");
+  for(int i = 0; i < SLAB_CLASSES; i++){
+    lslab* c = &slabs[i];
+    printf("%-6s %6zu %10li %10li %10li %5.1f%%\n", c->name, c->size,
+      c->live, c->slots, c->slabs,
+      c->slots ? 100.0 * c->live / c->slots : 0.0);
+  }
+  printf("live bytes %zu, peak %zu\n", slab_bytes, slab_peak_bytes);
+#ifdef LISPTER_ARENA
+  printf("arena used %zu of %i, live %li, resets %li, promoted %li\n",
+    arena.used, ARENA_SIZE, arena.live, arena.resets, arena.promoted);
+#endif
+  lval_del(a);
+  return lval_sexpr();
+}
+
 lval* builtin_error(lenv* env, lval* a){
   LASSERT_NUM("error", a, 1);
   LASSERT_TYPE("error", a, 0, LVAL_STR);
@@ -1075,6 +4080,15 @@ void lenv_add_builtin(lenv* env, char* name, lbuiltin func){
   lval_del(k); lval_del(v);
 }
 
+//Add a builtin that also has a fast entry
+void lenv_add_fast(lenv* env, char* name, lbuiltin func, lfast fast){
+  lval* k = lval_sym(name);
+  lval* v = lval_fun(func);
+  v->fast = fast;
+  lenv_put(env, k, v);
+  lval_del(k); lval_del(v);
+}
+
 void len_add_builtins(lenv* env){
   //List functions
   lenv_add_builtin(env, "\\", builtin_lambda);
@@ -1083,77 +4097,72 @@ void len_add_builtins(lenv* env){
   lenv_add_builtin(env, "tail", builtin_tail);
   lenv_add_builtin(env, "join", builtin_join);
   lenv_add_builtin(env, "eval", builtin_eval);
+  lenv_add_builtin(env, "len", builtin_len);
+  lenv_add_builtin(env, "nth", builtin_nth);
+  lenv_add_builtin(env, "slice", builtin_slice);
+  lenv_add_builtin(env, "conj", builtin_conj);
+  lenv_add_builtin(env, "map", builtin_map);
+  lenv_add_builtin(env, "filter", builtin_filter);
+  lenv_add_builtin(env, "foldl", builtin_foldl);
+  lenv_add_builtin(env, "foldr", builtin_foldr);
+  lenv_add_builtin(env, "reverse", builtin_reverse);
+  lenv_add_builtin(env, "range", builtin_range);
+
+  //Persistent vector functions
+  lenv_add_builtin(env, "vec", builtin_vec);
+  lenv_add_builtin(env, "assoc-nth", builtin_assoc_nth);
+  lenv_add_builtin(env, "concat", builtin_concat);
+
+  //Numeric vector functions
+  lenv_add_builtin(env, "nums", builtin_nums);
+  lenv_add_builtin(env, "v+", builtin_vadd);
+  lenv_add_builtin(env, "v-", builtin_vsub);
+  lenv_add_builtin(env, "v*", builtin_vmul);
+  lenv_add_builtin(env, "v/", builtin_vdiv);
+  lenv_add_builtin(env, "v%", builtin_vmod);
+  lenv_add_builtin(env, "v<", builtin_vlt);
+  lenv_add_builtin(env, "v>", builtin_vgt);
+  lenv_add_builtin(env, "v<=", builtin_vle);
+  lenv_add_builtin(env, "v>=", builtin_vge);
+  lenv_add_builtin(env, "v==", builtin_veq);
+  lenv_add_builtin(env, "v!=", builtin_vne);
+  lenv_add_builtin(env, "sum", builtin_sum);
+  lenv_add_builtin(env, "min", builtin_min);
+  lenv_add_builtin(env, "max", builtin_max);
+  lenv_add_builtin(env, "dot", builtin_dot);
   //Arithmetic Functons
-  lenv_add_builtin(env, "+", builtin_add);
-  lenv_add_builtin(env, "*", builtin_mul);
-  lenv_add_builtin(env, "-", builtin_sub);
-  lenv_add_builtin(env, "/", builtin_div);
-  lenv_add_builtin(env, "%", builtin_mod);
+  lenv_add_fast(env, "+", builtin_add, fast_add);
+  lenv_add_fast(env, "*", builtin_mul, fast_mul);
+  lenv_add_fast(env, "-", builtin_sub, fast_sub);
+  lenv_add_fast(env, "/", builtin_div, fast_div);
+  lenv_add_fast(env, "%", builtin_mod, fast_mod);
   //Variable functions
   lenv_add_builtin(env, "def", builtin_def);
   lenv_add_builtin(env, "=", builtin_put);
   lenv_add_builtin(env, "error", builtin_error);
   lenv_add_builtin(env, "load", builtin_load);
   lenv_add_builtin(env, "print", builtin_print);
+  lenv_add_builtin(env, "memstats", builtin_memstats);
   //Ordering functions
-  lenv_add_builtin(env, ">", builtin_gt);
-  lenv_add_builtin(env, "<", builtin_lt);
-  lenv_add_builtin(env, "<=", builtin_le);
-  lenv_add_builtin(env, ">=", builtin_ge);
+  lenv_add_fast(env, ">", builtin_gt, fast_gt);
+  lenv_add_fast(env, "<", builtin_lt, fast_lt);
+  lenv_add_fast(env, "<=", builtin_le, fast_le);
+  lenv_add_fast(env, ">=", builtin_ge, fast_ge);
   //Equality ops
-  lenv_add_builtin(env, "==",builtin_eq);
-  lenv_add_builtin(env, "!=",builtin_neq);
+  lenv_add_fast(env, "==", builtin_eq, fast_eq);
+  lenv_add_fast(env, "!=", builtin_neq, fast_neq);
   //Condifitional
   lenv_add_builtin(env, "if", builtin_if);
-}
-
-
-//Evaluate a symbolic or quoted expression
-lval* eval_sexpr(lenv* env, lval* v){
-  //Evaluate the children
-  for(int i=0; i < v->count; i++){
-    v->cell[i] = eval(env, v->cell[i]);
-  }
-
-  //Check for errors
-  for(int i=0; i < v->count; i++){
-    if(v->cell[i]->type == LVAL_ERR) {
-      return take(v,i);
-    }
-  }
-
-  //Empty eexpression 
-  if(v->count == 0) { 
-    return v;
-  }
 
-  //Single expression
-  if(v-> count == 1){
-    return eval(env,take(v, 0));
-  }
-
-  //Check first element is function after evaluation
-  lval* f = pop(v, 0);
-  if(f->type != LVAL_FUN){
-    lval* err = lval_err(
-      "S-Expression Starts with incorrect type."
-      "Got %s, Expected %s ", 
-      ltype_name(f->type), ltype_name(LVAL_FUN)
-      );
-    lval_del(v); lval_del(f);
-    return err;
+  //Mark the names calls may be folded through
+  for(int i = 0; i < LPURE_COUNT; i++){
+    LSYM(lsym_intern(lpure[i].name, NULL))->pure = 1;
   }
-
-  //If it is call function to get result
-  lval* result = lval_call(env,f,v);
-  lval_del(f);
-  return result;
 }
 
 
-
-
-int main (int argc, char** argv){
+//Create and define the parsers for the language
+void parsers_init(void){
   //Create parsers
   Number = mpc_new("number");
   Symbol = mpc_new("symbol");
@@ -1177,10 +4186,23 @@ int main (int argc, char** argv){
     lispy: /^/<expr>* /$/;                                  \
     ",
       Number, Symbol, String, Comment, Sexpr, Expr, Qexpr, Lispy);
+}
+
+void parsers_cleanup(void){
+  mpc_cleanup(8, Number, Symbol, String, Comment, Sexpr, Qexpr, Expr, Lispy);
+}
+
+//Benchmarks include this file and provide their own main
+#ifndef LISPTER_NO_MAIN
+int main (int argc, char** argv){
+  parsers_init();
 
   //Create a new env and add the builtins
   lenv* env = lenv_new();
   assert(env != NULL);
+#ifdef LISPTER_GC
+  gc.root = env;
+#endif
   len_add_builtins(env);
 
 
@@ -1193,7 +4215,7 @@ int main (int argc, char** argv){
 
       lval* x = builtin_load(env, args);
 
-      if(x->type == LVAL_ERR){ lval_println(x);}
+      if(LVAL_TYPE(x) == LVAL_ERR){ lval_println(x);}
       lval_del(x);
     }
 
@@ -1220,9 +4242,11 @@ int main (int argc, char** argv){
       mpc_result_t res;
   
       if(mpc_parse("<stdin>",input, Lispy, &res)){
+        arena_begin();
         lval* x = eval(env, lval_read(res.output));
         lval_println(x);
         lval_del(x);
+        arena_end();
         
       }else {
         /*If error print the error message*/
@@ -1235,6 +4259,12 @@ int main (int argc, char** argv){
   }
 
   lenv_del(env);
-  mpc_cleanup(8, Number, Symbol, String, Comment, Sexpr, Qexpr, Expr, Lispy);
+#ifdef LISPTER_GC
+  //Nothing is reachable any more so this frees everything
+  gc.root = NULL;
+  gc_collect();
+#endif
+  parsers_cleanup();
   return 0;
-}
\ No newline at end of file
+}
+#endif
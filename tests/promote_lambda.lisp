@@ -0,0 +1,12 @@
+; A lambda compiled while its body still held arena values is
+; stored with def. Its code must not point at the old values.
+; Should print {7 8 1} then {7 8 2}
+(def {fun} (\ {f b} {def (head f) (\ (tail f) b)}))
+(fun {seq a b} {b})
+; Fills the arena, so later values of the form spill to the slabs
+(fun {burn n} {if (== n 0) {0} {burn (seq (list n n n) (- n 1))}})
+(fun {mk c} {seq (burn 20000) (seq (= {g} (\ {x} (join {join} (list c) {(list x)}))) (seq (g 1) g))})
+(def {n} 8)
+(def {f} (mk (list 7 n)))
+(print (f 1))
+(print (f 2))